@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+    Generate the CORDIC arctangent table and sweep the accuracy of the
+    firmware angle engine (v4/fw/calc.c) over every possible input.
+
+    The integer arithmetic below mirrors the C implementation step by step,
+    so the reported errors are the errors of the firmware.
+"""
+
+import sys
+import math
+import numpy as np
+
+
+ITERATIONS = 16
+SHIFT = 13              # Inputs are scaled to Q13 before the iterations
+ANGLE_SCALE = 256       # Table and accumulator in 1/256 centidegrees
+
+TABLE = [round(math.degrees(math.atan(2.0**-i)) * 100 * ANGLE_SCALE) for i in range(ITERATIONS)]
+DEG90 = 90 * 100 * ANGLE_SCALE
+
+GAIN = math.prod(math.sqrt(1 + 2.0**(-2 * i)) for i in range(ITERATIONS))
+GAIN_Q14 = round(GAIN * (1 << 14))
+
+INT32_MAX = 2**31 - 1
+
+
+def cordic_vector(x, y):
+    """ Mirror of cordic_vector(): returns (angle, magnitude * gain) """
+    x = np.asarray(x, dtype=np.int64).copy()
+    y = np.asarray(y, dtype=np.int64).copy()
+    z = np.zeros_like(x)
+
+    # Pre-rotation into the right half-plane
+    neg = x < 0
+    up = neg & (y >= 0)
+    down = neg & (y < 0)
+    t = x.copy()
+    x = np.where(up, y, np.where(down, -y, x))
+    y = np.where(up, -t, np.where(down, t, y))
+    z = np.where(up, DEG90, np.where(down, -DEG90, z))
+
+    for i in range(ITERATIONS):
+        dx = y >> i
+        dy = x >> i
+        pos = y >= 0
+        x = np.where(pos, x + dx, x - dx)
+        y = np.where(pos, y - dy, y + dy)
+        z = np.where(pos, z + TABLE[i], z - TABLE[i])
+        assert np.abs(x).max() <= INT32_MAX and np.abs(y).max() <= INT32_MAX
+
+    return z, x
+
+
+def to_centidegrees(z):
+    return (z + ANGLE_SCALE // 2) >> 8
+
+
+def cordic_atan2(y, x):
+    """ Mirror of cordic_atan2() in centidegrees """
+    z, _ = cordic_vector(np.asarray(x, dtype=np.int64) << SHIFT, np.asarray(y, dtype=np.int64) << SHIFT)
+    return to_centidegrees(z)
+
+
+def cordic_azel(x, y, height):
+    """ Mirror of the azimuth/elevation calculation in calculate_angles() """
+    az, r = cordic_vector(-np.asarray(x, dtype=np.int64) << SHIFT, -np.asarray(y, dtype=np.int64) << SHIFT)
+    h = (np.int64(height) * GAIN_Q14) >> (14 - SHIFT)
+    el, _ = cordic_vector(r, np.full_like(r, h))
+    return to_centidegrees(az), to_centidegrees(el)
+
+
+def report(name, err):
+    err = np.abs(err)
+    print("%-10s max %.4f deg, rms %.4f deg" % (name, err.max() / 100, math.sqrt(np.mean(err**2)) / 100))
+    return err.max()
+
+
+def sweep(height, limit):
+    """ Exhaustive sweep over the position range -limit..limit """
+
+    # Axis angles: every x for the given height
+    x = np.arange(-limit, limit + 1)
+    ref = np.degrees(np.arctan2(x, height)) * 100
+    worst = report("axis", cordic_atan2(x, height) - ref)
+
+    # Azimuth and elevation: every (x, y) pair
+    x, y = np.meshgrid(np.arange(-limit, limit + 1), np.arange(-limit, limit + 1))
+    x, y = x.ravel(), y.ravel()
+    az, el = cordic_azel(x, y, height)
+
+    ref_az = np.degrees(np.arctan2(-y, -x)) * 100
+    err_az = az - ref_az
+    err_az = (err_az + 18000) % 36000 - 18000 # +-180 wraps around
+    err_az[(x == 0) & (y == 0)] = 0 # Undefined
+    worst = max(worst, report("azimuth", err_az))
+
+    ref_el = np.degrees(np.arctan2(height, np.hypot(x, y))) * 100
+    worst = max(worst, report("elevation", el - ref_el))
+    return worst
+
+
+if __name__ == "__main__":
+
+    print("#define CORDIC_GAIN_Q14 %d" % GAIN_Q14)
+    print("static const int32_t cordic_atan[CORDIC_ITERATIONS] = {")
+    for i in range(0, ITERATIONS, 4):
+        print("    " + " ".join("%8d," % v for v in TABLE[i:i+4]))
+    print("};")
+    print()
+
+    heights = [int(h) for h in sys.argv[1:]] or [670]
+    worst = 0
+    for height in heights:
+        print("height %d:" % height)
+        worst = max(worst, sweep(height, 2048))
+
+    print("worst error %.4f deg" % (worst / 100))
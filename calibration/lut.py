@@ -1,61 +1,228 @@
+#!/usr/bin/env python3
 """
-    Generate position to angle look-up table
+    Generate the arctangent look-up table of the v4 firmware (ANGLE_LUT).
+
+    The table covers one octant, atan(t) for t = 0 - 1 in Q15, and is
+    interpolated linearly. The node values are tuned for minimum max error
+    (not interpolating the curve) and stored as 8-bit deltas with a 16-bit
+    anchor every ANCHOR nodes.
+
+    The segments are uniform with a power-of-two width, so the interpolation
+    never divides and the segment is found with a shift. Non-uniform
+    breakpoints were tried: the error per segment barely improves and the
+    breakpoint table costs more FRAM than the deltas save, more than a plain
+    int16 table. The integer lookup of the firmware (calc.c) is mirrored here
+    and checked over every t.
+
+    Examples:
+        ./lut.py --size 32                     # 32 segments
+        ./lut.py --error 0.01                  # fewest segments for 0.01 deg
+        ./lut.py --size 32 -o ../v4/fw/atan_lut.h
+        ./lut.py --variants                    # compare the sizes
 """
 
-import matplotlib
-import matplotlib.pyplot as plt
-import numpy as np
+import sys
 import math
+import argparse
 
 
-ATAN_RATIO = 256
-LUT_SIZE = 256
-ADC = 1024
+T_ONE = 1 << 15         # t = 1.0 in Q15
+RIGHT = 9000            # 90 degrees in centidegrees
+
+# Estimated MSP430 cycles of the lookup parts (see calc.c)
+CYCLES_FIXED = 230      # Q15 division, interpolation multiply and octant logic
+CYCLES_DELTA = 6        # One delta addition from the anchor
+
 
-RATIO = ADC // LUT_SIZE
-
-
-def real(x):
-    return 10 * math.degrees(math.atan2(x, ATAN_RATIO))
-
-LUT = np.empty(LUT_SIZE)
-for i in range(LUT_SIZE):
-    LUT[i] = round(real(RATIO * i))
-
-
-for i in range(128//8):
-    print(", ".join("%4d" % x for x in LUT[8*i:8*(i+1)]) )
-
-
-def lut_tan(x):
-    pos = x // RATIO
-    if pos >= LUT_SIZE - 1:
-        return LUT[-1]
-    return round(LUT[pos] + ((x - 4*pos) * (LUT[pos + 1] - LUT[pos])) // RATIO)
-
-
-if 1:
-    fig, ax = plt.subplots()
-    ax.step(range(LUT_SIZE), LUT)
-
-    ax.set(xlabel='ADC count', ylabel='Angle', title='Lookup table')
-    ax.grid()
-
-else:
-
-    t = np.empty(ADC)
-    err = np.empty(ADC)
-    for i in range(ADC):
-
-        t[i] = i
-        err[i] = abs(real(i) - lut_tan(i))
-        #print(real(i), lut_tan(i))
-
-
-    fig, ax = plt.subplots()
-    ax.plot(t, err)
-
-    ax.set(xlabel='ADC count', ylabel='Error', title='Error in degrees (max %.2f, std: %.2f)' % (max(err), np.std(err)))
-    ax.grid()
-
-plt.show()
+def atan_cd(t):
+    """ Exact atan of Q15 t in centidegrees """
+    return math.degrees(math.atan(t / T_ONE)) * 100
+
+
+def segment_error(t0, w, y0, y1):
+    """ Max and min of f - interpolation over a segment """
+    hi, lo = -1e9, 1e9
+    step = max(1, w // 64)
+    for f in list(range(0, w, step)) + [w]:
+        e = atan_cd(t0 + f) - (y0 + (y1 - y0) * f / w)
+        hi, lo = max(hi, e), min(lo, e)
+    return hi, lo
+
+
+def minimax_nodes(breaks):
+    """ Node values with the error equalized over the neighbouring segments """
+    n = len(breaks) - 1
+    y = [atan_cd(t) for t in breaks]
+    for _ in range(20):
+        err = [segment_error(breaks[i], breaks[i + 1] - breaks[i], y[i], y[i + 1]) for i in range(n)]
+        mid = [(hi + lo) / 2 for hi, lo in err]
+        y = [y[0] + mid[0]] + \
+            [y[i] + (mid[i - 1] + mid[i]) / 2 for i in range(1, n)] + \
+            [y[n] + mid[n - 1]]
+    return y
+
+
+def uniform_breaks(size):
+    w = T_ONE // size
+    return [i * w for i in range(size + 1)]
+
+
+class Table:
+
+    def __init__(self, size, anchor):
+        self.size = size
+        self.anchor = anchor
+        self.shift = int(math.log2(T_ONE // size))
+
+        y = minimax_nodes(uniform_breaks(size))
+
+        # Finest fraction of a centidegree that keeps every delta in 8 bits
+        self.frac = 0
+        while self.frac < 8 and max(b - a for a, b in zip(y, y[1:])) * (2 << self.frac) <= 255:
+            self.frac += 1
+
+        self.nodes = [round(v * (1 << self.frac)) for v in y]
+        self.deltas = [b - a for a, b in zip(self.nodes, self.nodes[1:])]
+        self.anchors = [self.nodes[i] for i in range(0, self.size + 1, anchor)]
+        self.valid = all(0 <= d <= 255 for d in self.deltas)
+
+    # Integer mirror of the firmware lookup
+
+    def node(self, i):
+        j = i & ~(self.anchor - 1)
+        y = self.anchors[j // self.anchor]
+        while j < i:
+            y += self.deltas[j]
+            j += 1
+        return y
+
+    def octant(self, t):
+        w = self.shift
+        i = t >> w
+        f = t & ((1 << w) - 1)
+        if i == self.size:
+            i -= 1
+            f = 1 << w
+        return self.node(i) + ((self.deltas[i] * f + (1 << w >> 1)) >> w)
+
+    def centidegrees(self, y):
+        return (y + (1 << self.frac >> 1)) >> self.frac
+
+    def max_error(self):
+        """ Max error over every t of both octants [centidegrees] """
+        worst = 0
+        right = RIGHT << self.frac
+        for t in range(T_ONE + 1):
+            y = self.octant(t)
+            exact = atan_cd(t)
+            worst = max(worst, abs(self.centidegrees(y) - exact),
+                        abs(self.centidegrees(right - y) - (RIGHT - exact)))
+        return worst
+
+    def fram_bytes(self):
+        return len(self.deltas) + 2 * len(self.anchors)
+
+    def worst_cycles(self):
+        return CYCLES_FIXED + (self.anchor - 1) * CYCLES_DELTA
+
+    def describe(self):
+        if not self.valid:
+            return "%4d segments  deltas do not fit 8 bits" % self.size
+        return "%4d segments  max error %.4f deg  %4d bytes FRAM (int16 table %4d)  " \
+               "lookup: %d delta adds, ~%d cycles" % (
+                   self.size, self.max_error() / 100, self.fram_bytes(), 2 * (self.size + 1),
+                   self.anchor - 1, self.worst_cycles())
+
+
+def build(size, error, anchor):
+    """ Smallest table meeting the error target, or the table of the given size """
+    if size:
+        return Table(size, anchor)
+    size = 4
+    while size < 4096:
+        table = Table(size, anchor)
+        if table.valid and table.max_error() <= error:
+            return table
+        size *= 2
+    sys.exit("No table meets %.4f deg" % (error / 100))
+
+
+def header(table, args):
+    out = []
+    out.append("/*")
+    out.append(" * Arctangent look-up table, generated by calibration/lut.py. Do not edit.")
+    out.append(" * lut.py %s" % " ".join(args))
+    out.append(" * %s" % table.describe().split("  lookup")[0].strip())
+    out.append(" */")
+    out.append("")
+    out.append("#ifndef ATAN_LUT_H")
+    out.append("#define ATAN_LUT_H")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    define = lambda name, value, comment: out.append("#define %-16s %-5s // %s" % (name, value, comment))
+    define("ATAN_LUT_SIZE", table.size, "Segments over t = 0 - 1 (Q15)")
+    define("ATAN_LUT_ANCHOR", table.anchor, "Nodes per anchor")
+    define("ATAN_LUT_FRAC", table.frac, "Node values in 1/2^FRAC centidegrees")
+    define("ATAN_LUT_SHIFT", table.shift, "log2 of the segment width")
+    out.append("")
+
+    def array(ctype, name, values, per_line=8):
+        out.append("static const %s %s[%d] = {" % (ctype, name, len(values)))
+        for i in range(0, len(values), per_line):
+            out.append("    " + " ".join("%5d," % v for v in values[i:i + per_line]))
+        out.append("};")
+        out.append("")
+
+    array("uint16_t", "atan_lut_anchor", table.anchors)
+    array("uint8_t", "atan_lut_delta", table.deltas)
+
+    out.append("#endif /* ATAN_LUT_H */")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the arctangent look-up table")
+    parser.add_argument("--size", type=int, help="Number of segments")
+    parser.add_argument("--error", type=float, default=0.01, help="Max error target without --size [deg]")
+    parser.add_argument("--anchor", type=int, default=8, help="Nodes per 16-bit anchor, power of two")
+    parser.add_argument("--variants", action="store_true", help="Print the error and cost of the variants")
+    parser.add_argument("--plot", action="store_true", help="Plot the error over t")
+    parser.add_argument("-o", "--output", help="Header file to write")
+    args = parser.parse_args()
+
+    if args.anchor < 1 or args.anchor & (args.anchor - 1):
+        sys.exit("--anchor must be a power of two")
+    if args.size and (args.size & (args.size - 1) or args.size > T_ONE):
+        sys.exit("--size must be a power of two")
+
+    if args.variants:
+        for size in [16, 32, 64, 128]:
+            print(build(size, None, args.anchor).describe())
+        return
+
+    table = build(args.size, args.error * 100, args.anchor)
+    if not table.valid:
+        sys.exit("Deltas do not fit 8 bits, use more segments")
+    print(table.describe(), file=sys.stderr)
+
+    if args.plot:
+        import matplotlib.pyplot as plt
+        t = range(0, T_ONE + 1, 8)
+        err = [(table.octant(v) / (1 << table.frac) - atan_cd(v)) / 100 for v in t]
+        fig, ax = plt.subplots()
+        ax.plot([v / T_ONE for v in t], err)
+        ax.set(xlabel='t', ylabel='Error [deg]', title=table.describe().split("  lookup")[0])
+        ax.grid()
+        plt.show()
+
+    text = header(table, sys.argv[1:])
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
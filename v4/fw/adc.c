@@ -1,15 +1,69 @@
 #include <msp430.h>
 #include "main.h"
 #include "calc.h"
+#include "adc.h"
+#include "sample.h"
+#include "fixmath.h"
+#include "profile.h"
+#include "energy.h"
 
 volatile int adc_done;
+volatile uint8_t adc_timed_out;
 volatile int samples_todo;
 volatile int16_t temperature_raw;
+volatile int temperature_due, temperature_sampled;
 
+temperature_t temperature;
+
+volatile uint8_t sun_present = 1;
+static volatile int sun_monitoring;
+
+// Temperature conversion: deciDegC = (raw * slope + offset) >> 12
+static int32_t temperature_slope, temperature_offset;
+static unsigned int temperature_counter;
+
+#ifndef CAL_ADC_15T30 // The host emulator has its own TLV values
 #define CAL_ADC_15T30  *((uint16_t *)0x1A1A)   // Temperature Sensor Calibration-30 C for 1V5 (value around 675)
                                                // See device-specific datasheet for TLV table memory mapping
 #define CAL_ADC_15T85  *((uint16_t *)0x1A1C)   // Temperature Sensor Calibration-85 C for 1V5 (value around 802)
+#endif
+
+
+/*
+ * ADC input channels of the PSD electrodes
+ */
+#ifdef V4X
+#define CH_VX1  ADCINCH_1
+#define CH_VX2  ADCINCH_3
+#define CH_VY1  ADCINCH_4
+#define CH_VY2  ADCINCH_5
+#else
+#define CH_VX1  ADCINCH_5
+#define CH_VX2  ADCINCH_4
+#define CH_VY1  ADCINCH_3
+#define CH_VY2  ADCINCH_1
+#endif
 
+static uint16_t sun_channel = CH_VX1;
+
+/*
+ * Sums of squares of the oversampled conversions for the noise statistics
+ */
+static raw_squares_t raw_sq;
+static volatile uint8_t noise_stats;
+
+uint32_t raw_variance;
+
+#define ACCUMULATE(ch, adc) do { \
+		uint16_t v = (adc); \
+		raw.ch += v; \
+		if (noise_stats) { \
+			mpy_state_t mpy; \
+			MPY_SAVE(mpy); \
+			raw_sq.ch += fix_mul_u16(v, v); \
+			MPY_RESTORE(mpy); \
+		} \
+	} while (0)
 
 /*
  * Port 2.7 can be used for timing analysis purposes
@@ -30,13 +84,53 @@ void init_adc(void)
 	ADCCTL2 = ADCRES_1 | ADCDF_0 | ADCSR;                               // 10-bit conversion results, unsigned, 50ksps
 
 	ADCIE |= ADCIE0;                                                    // Enable the interrupt request for a completed ADC conversion
+
+	// Precompute the temperature sensor slope and offset from the TLV values
+	// so that the conversion does not need a division.
+	int32_t cal30 = CAL_ADC_15T30, cal85 = CAL_ADC_15T85;
+	temperature_slope = ((int32_t)(850 - 300) << 12) / (cal85 - cal30);
+	temperature_offset = ((int32_t)300 << 12) - fix_mul_s32_s16(temperature_slope, (int16_t)cal30);
+}
+
+static void store_temperature(void)
+{
+	temperature.value = (int16_t)((fix_mul_s32_s16(temperature_slope, temperature_raw) + temperature_offset) >> 12);
+	temperature.time = get_timestamp();
+	temperature.valid = 1;
 }
 
 
-void read_voltage_channels()
+/*
+ * Sleep in LPM0 until the conversions started are done, for at most
+ * timeout ms. CCR1 of Timer B0 wakes the CPU at the timeout, so a stalled
+ * ADC costs the timeout and not a wait for other interrupts.
+ * Returns 1 if the conversions are done.
+ */
+static int wait_conversions(uint16_t timeout)
+{
+	adc_timed_out = 0;
+	TB0CCR1 = (uint16_t)get_timer_ticks() + (uint16_t)(timeout * TIMER_HZ / 1000);
+	TB0CCTL1 = CCIE;
+
+	while (!adc_done && !adc_timed_out) {
+		ENERGY_MODE(POWER_LPM0);
+		__bis_SR_register(LPM0_bits + GIE);
+		ENERGY_MODE(POWER_ACTIVE);
+		__no_operation(); // Wait few ticks
+		__no_operation();
+		__no_operation();
+	}
+
+	TB0CCTL1 = 0;
+	return adc_done;
+}
+
+
+unsigned int read_voltage_channels(unsigned int samples)
 {
 
 	START_TIMING();
+	PROFILE_START(PROF_SAMPLE);
 
 	/* Wakeup the opamp and ADC if needed */
 	if (sleep_mode)
@@ -49,12 +143,28 @@ void read_voltage_channels()
 
 	// reset raw values
 	raw.vx1 = raw.vx2 = raw.vy1 = raw.vy2 = 0;
+	raw_sq.vx1 = raw_sq.vx2 = raw_sq.vy1 = raw_sq.vy2 = 0;
 
 	adc_done = 0;
-	samples_todo = calibration.samples;
-	// prevent wrong calibration values
-	if (samples_todo == 0 || samples_todo % 2 != 0)
-		samples_todo = 1;
+	temperature_sampled = 0;
+	if (++temperature_counter >= TEMPERATURE_INTERVAL) {
+		temperature_counter = 0;
+		temperature_due = 1;
+	}
+
+	// Only powers of two can be averaged with a shift
+	unsigned int shift = 0;
+	while ((samples >> shift) > 1)
+		shift++;
+	if (samples == 0 || samples > SAMPLES_MAX || samples != (1u << shift)) {
+		samples = 1;
+		shift = 0;
+	}
+	samples_todo = samples;
+
+	// Variance can be estimated only from multiple samples
+	noise_stats = (sampling_config.report_noise && samples > 1);
+	raw_variance = UINT32_MAX;
 
 	ADCCTL0 &= ~ADCENC;                 // Force disable ADC for configuring
 	ADCMCTL0 = ADCSREF_2 + ADCINCH_5;   // Select first ADC input channel (VX1)
@@ -63,43 +173,27 @@ void read_voltage_channels()
 	// interrupts for finished conversions will be triggered in sequence
 
 	// Wait the ADC conversions to end
-	i = 100;
-	while (!adc_done && i-- > 0) {
-		__bis_SR_register(LPM0_bits + GIE);
-		__no_operation(); // Wait few ticks
-		__no_operation();
-		__no_operation();
-	}
-
+	uint8_t done = wait_conversions(samples * SAMPLE_DURATION +
+	                                (temperature_due ? CONVERSION_DURATION : 0) + ADC_TIMEOUT_MARGIN);
 	adc_done = 0;
+	temperature_due = 0;
+
+	if (temperature_sampled)
+		store_temperature();
 
-	if (i == 0) { // ADC is not able to conversion!
+	if (!done) { // ADC is not able to conversion!
 	    // set raw values to indicate wrong numbers
 		raw.vx1 = raw.vx2 = raw.vy1 = raw.vy2 = 0xFFFF;
-		return;
+		PROFILE_STOP(PROF_SAMPLE);
+		STOP_TIMING();
+		return samples;
 	}
 
-	if (calibration.samples == 2) {
-		raw.vx1 >>= 1; raw.vx2 >>= 1;
-		raw.vy1 >>= 1; raw.vy2 >>= 1;
-	}
-	else if (calibration.samples == 4) {
-		raw.vx1 >>= 2; raw.vx2 >>= 2;
-		raw.vy1 >>= 2; raw.vy2 >>= 2;
-	}
-	else if (calibration.samples == 8) {
-		raw.vx1 >>= 3; raw.vx2 >>= 3;
-		raw.vy1 >>= 3; raw.vy2 >>= 3;
-	}
-	/*else if (calibration.samples == 16) {
-		raw.vx1 >>= 4; raw.vx2 >>= 4;
-		raw.vy1 >>= 4; raw.vy2 >>= 4;
-	}
-	else {
-		raw.vx1 /= calibration.samples; raw.vx2 /= calibration.samples;
-		raw.vy1 /= calibration.samples; raw.vy2 /= calibration.samples;
-	}*/
+	if (noise_stats)
+		raw_variance = calculate_variance(&raw_sq, shift);
 
+	raw.vx1 >>= shift; raw.vx2 >>= shift;
+	raw.vy1 >>= shift; raw.vy2 >>= shift;
 
 	// raw = 1023-raw
 	// XOR is more effective than subtraction
@@ -108,7 +202,9 @@ void read_voltage_channels()
 	raw.vy1 = 1023 ^ raw.vy1;
 	raw.vy2 = 1023 ^ raw.vy2;
 
+	PROFILE_STOP(PROF_SAMPLE);
 	STOP_TIMING();
+	return samples;
 }
 
 
@@ -130,26 +226,76 @@ int16_t read_temperature()
     ADCMCTL0 = ADCSREF_1 + ADCINCH_12; // Compare ADC channel 12 against 1.5V reference
     ADCCTL0 |= ADCENC + ADCSC; // Sampling and conversion start
 
-    i = 100;
-    while (!adc_done && i-- > 0) {
-        __bis_SR_register(LPM0_bits + GIE);
-        __no_operation(); // Wait few ticks
-        __no_operation();
-        __no_operation();
-    }
-
-    if (i == 0) { // ADC is not able to conversion!
-        return 0xFFFF;
+    if (!wait_conversions(CONVERSION_DURATION + ADC_TIMEOUT_MARGIN)) { // ADC is not able to conversion!
+        STOP_TIMING();
+        return TEMPERATURE_ERROR;
     }
 
-    // int32_t needed because otherwise pre1 and 2 will overflow
-	int32_t pre1 =  (temperature_raw - (int32_t)CAL_ADC_15T30)* (850 - 300);
-	int32_t pre2 = (int32_t)CAL_ADC_15T85 - (int32_t)CAL_ADC_15T30;
-	temperature_raw = (pre1 / pre2) + 300;
+	store_temperature();
 
 	STOP_TIMING();
     // Calculate calibrated temperature in deciCelciuses
-    return (temperature_raw + calibration.temperature_bias);
+    return (temperature.value + calibration.temperature_bias);
+}
+
+
+void update_sun_presence()
+{
+	uint16_t level = raw.vx1;
+	sun_channel = CH_VX1;
+	if (raw.vx2 > level) {
+		level = raw.vx2;
+		sun_channel = CH_VX2;
+	}
+	if (raw.vy1 > level) {
+		level = raw.vy1;
+		sun_channel = CH_VY1;
+	}
+	if (raw.vy2 > level) {
+		level = raw.vy2;
+		sun_channel = CH_VY2;
+	}
+
+	if (level < sampling_config.sun_off)
+		sun_present = 0;
+	else if (level > sampling_config.sun_on)
+		sun_present = 1;
+}
+
+
+void monitor_sun()
+{
+	uint8_t was_sleeping = sleep_mode;
+	if (sleep_mode)
+		wakeup();
+
+	// Wait for existing conversion
+	unsigned int i = 100;
+	while ((ADCCTL1 & ADCBUSY) && i-- > 0)
+		__no_operation();
+
+	adc_done = 0;
+	sun_monitoring = 1;
+
+	// Conversion results are inverted: more light gives a lower result.
+	// ADCLOIFG means the sun is back, ADCHIIFG that it is still in eclipse
+	// and the hysteresis band in between keeps the current state.
+	ADCCTL0 &= ~ADCENC;
+	ADCHI = 1023 - sampling_config.sun_off;
+	ADCLO = 1023 - sampling_config.sun_on;
+	ADCIFG &= ~(ADCHIIFG | ADCLOIFG);
+	ADCIE |= ADCHIIE | ADCLOIE;
+	ADCMCTL0 = ADCSREF_2 + sun_channel;
+	ADCCTL0 |= ADCENC | ADCSC;
+
+	wait_conversions(CONVERSION_DURATION + ADC_TIMEOUT_MARGIN);
+
+	ADCIE &= ~(ADCHIIE | ADCLOIE);
+	sun_monitoring = 0;
+	adc_done = 0;
+
+	if (was_sleeping)
+		sleepmode();
 }
 
 
@@ -166,11 +312,23 @@ __interrupt void ADC_ISR(void)
 	case ADCIV__NONE: break;                // No interrupt
 	case ADCIV__ADCOVIFG: break;            // conversion result overflow
 	case ADCIV__ADCTOVIFG: break;           // conversion time overflow
-	case ADCIV__ADCHIIFG: break;            // ADCHI
-	case ADCIV__ADCLOIFG: break;            // ADCLO
+	case ADCIV__ADCHIIFG:                   // ADCHI: channel dark, still in eclipse
+		sun_present = 0;
+		break;
+	case ADCIV__ADCLOIFG:                   // ADCLO: channel lit, sun is back
+		sun_present = 1;
+		break;
 	case ADCIV__ADCINIFG: break;            // ADCIN
 	case ADCIV__ADCIFG0: {                  // ADCIFG0: End of conversion
 
+		if (sun_monitoring) {
+			// Window comparator flags have already been handled
+			ADCCTL0 &= ~ADCENC;
+			adc_done = 1;
+			__bic_SR_register_on_exit(LPM0_bits); // Exit LPM
+			break;
+		}
+
 		switch (ADCMCTL0 & 0x0F) {
 #ifdef V4X
         // P1.1 = VX1               Analog 1 IN
@@ -178,69 +336,78 @@ __interrupt void ADC_ISR(void)
         // P1.4 = VY1               Analog 4 IN
         // P1.5 = VY2               Analog 5 IN
         case ADCINCH_5:                      // A5: VY2
-			raw.vy2 += ADCMEM0;
+			ACCUMULATE(vy2, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_4; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_4:                      // A4: VY1
-			raw.vy1 += ADCMEM0;
+			ACCUMULATE(vy1, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_3; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_3:                      // A3: VX2
-			raw.vx2 += ADCMEM0;
+			ACCUMULATE(vx2, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_1; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_1:                      // A1: VX1
-			raw.vx1 += ADCMEM0;
+			ACCUMULATE(vx1, ADCMEM0);
 
 #else
 		case ADCINCH_5:                      // A5: VX1
-			raw.vx1 += ADCMEM0;
+			ACCUMULATE(vx1, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_4; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_4:                      // A4: VX2
-			raw.vx2 += ADCMEM0;
+			ACCUMULATE(vx2, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_3; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_3:                      // A3: VY1
-			raw.vy1 += ADCMEM0;
+			ACCUMULATE(vy1, ADCMEM0);
 			ADCCTL0 &= ~ADCENC;
 			ADCMCTL0 = ADCSREF_2 + ADCINCH_1; // Enable conversion for next channel
 			ADCCTL0 |= ADCENC + ADCSC;
 			break;
 
 		case ADCINCH_1:                      // A1: VY2
-			raw.vy2 += ADCMEM0;
+			ACCUMULATE(vy2, ADCMEM0);
 #endif
 			samples_todo--;
 			if (samples_todo == 0) {
 				ADCCTL0 &= ~ADCENC; // Stop sampling
-				adc_done = 1;
-				__bic_SR_register_on_exit(LPM0_bits); // Exit LPM
+				if (temperature_due) {
+					// Interleave a temperature conversion before waking up the main thread
+					temperature_due = 0;
+					ADCMCTL0 = ADCSREF_1 + ADCINCH_12;
+					ADCCTL0 |= ADCENC + ADCSC;
+				}
+				else {
+					adc_done = 1;
+					__bic_SR_register_on_exit(LPM0_bits); // Exit LPM
+				}
 			}
 			else {
 				ADCCTL0 &= ~ADCENC;
-				ADCMCTL0 = ADCSREF_1 + ADCINCH_4; // Enable conversion for next channel
+				ADCMCTL0 = ADCSREF_2 + ADCINCH_5; // Restart from the first channel for the next sample
 				ADCCTL0 |= ADCENC + ADCSC;
 			}
 			break;
 
 		case ADCINCH_12:                     // A12: Temperature sensor
 		    temperature_raw = ADCMEM0;
+		    temperature_sampled = 1;
 			ADCCTL0 &= ~ADCENC;
 			adc_done = 1;
 			__bic_SR_register_on_exit(LPM0_bits); // Exit LPM
@@ -3,22 +3,88 @@
 
 
 #include <stdint.h>
+#include "timestamp.h"
+
+typedef struct {
+	int16_t value;      // Temperature without calibration bias [deciDegC]
+	timestamp_t time;   // Time of the conversion
+	uint8_t valid;
+} temperature_t;
+
+/* Latest temperature conversion */
+extern temperature_t temperature;
+
+/*
+ * Sum of the variances of the four averaged channels of the latest sample
+ * in Q8 ADC LSB^2. UINT32_MAX if not available.
+ * Calculated only when noise reporting is enabled and more than one sample is averaged.
+ */
+extern uint32_t raw_variance;
+
+/* Sun presence, 0 while in eclipse */
+extern volatile uint8_t sun_present;
+
 /*
- * Enable and initialize internal ADC
+ * Enable and initialize internal ADC.
+ * Also precomputes the temperature conversion from the TLV calibration values.
  */
 void init_adc(void);
 
 
 /*
- *
+ * Sample the PSD channels into raw, averaging over the given number of samples.
+ * The count must be a power of two up to SAMPLES_MAX, otherwise one sample is taken.
+ * Returns the number of samples actually taken.
+ * Every TEMPERATURE_INTERVAL call also refreshes the temperature.
  */
-void read_voltage_channels();
+unsigned int read_voltage_channels(unsigned int samples);
+
+/* Maximum number of samples averaged in one measurement */
+#define SAMPLES_MAX 16
 
 /*
- * Sample internal temperature sensor.
+ * Duration of one sample of all four channels [ms]. The ADC runs on ACLK,
+ * a conversion takes 16 ADCCLK to sample and 11 to convert, 0.82 ms.
+ */
+#define SAMPLE_DURATION 4
+#define CONVERSION_DURATION (SAMPLE_DURATION / 4)
+
+/* Conversions not done this long after their duration time out [ms] */
+#define ADC_TIMEOUT_MARGIN 1
+
+/* Set by the Timer B0 CCR1 interrupt at a conversion timeout */
+extern volatile uint8_t adc_timed_out;
+
+/*
+ * Sample internal temperature sensor and update the temperature cache.
  * This command will wait for the measurement to happen and it will take few ticks
+ * Returns the calibrated temperature, TEMPERATURE_ERROR if the conversion timed out.
  */
 int16_t read_temperature();
 
+#define TEMPERATURE_ERROR INT16_MIN
+
+/*
+ * Update sun presence from the strongest channel of the latest sample
+ * using the hysteresis levels in sampling_config.
+ */
+void update_sun_presence(void);
+
+/*
+ * Single conversion of the strongest channel with the ADC window comparator.
+ * Used in eclipse to notice when the sun is visible again.
+ * This command will wait for the measurement to happen.
+ */
+void monitor_sun(void);
+
+/* Run the sun monitor every N systicks while in eclipse */
+#define SUN_MONITOR_PERIOD 16
+
+/* Refresh temperature along with every Nth voltage sampling */
+#define TEMPERATURE_INTERVAL 32
+
+/* Cached temperature older than this is refreshed on request [ms] */
+#define TEMPERATURE_MAX_AGE 10000
+
 
 #endif /* __ADC_H__ */
@@ -0,0 +1,42 @@
+/*
+ * Arctangent look-up table, generated by calibration/lut.py. Do not edit.
+ * lut.py --error 0.01 -o atan_lut.h
+ * 128 segments  max error 0.0075 deg   162 bytes FRAM (int16 table  258)
+ */
+
+#ifndef ATAN_LUT_H
+#define ATAN_LUT_H
+
+#include <stdint.h>
+
+#define ATAN_LUT_SIZE    128   // Segments over t = 0 - 1 (Q15)
+#define ATAN_LUT_ANCHOR  8     // Nodes per anchor
+#define ATAN_LUT_FRAC    2     // Node values in 1/2^FRAC centidegrees
+#define ATAN_LUT_SHIFT   8     // log2 of the segment width
+
+static const uint16_t atan_lut_anchor[17] = {
+        0,  1431,  2850,  4248,  5615,  6942,  8222,  9452,
+    10626, 11743, 12802, 13803, 14748, 15638, 16474, 17261,
+    18000,
+};
+
+static const uint8_t atan_lut_delta[128] = {
+      179,   179,   179,   179,   179,   179,   178,   179,
+      178,   178,   178,   177,   178,   177,   177,   176,
+      176,   176,   175,   175,   175,   174,   174,   173,
+      173,   172,   172,   171,   170,   170,   170,   169,
+      168,   167,   167,   166,   166,   165,   164,   164,
+      162,   162,   162,   160,   160,   159,   158,   157,
+      157,   156,   155,   154,   153,   153,   151,   151,
+      150,   149,   148,   147,   146,   146,   144,   144,
+      143,   142,   141,   140,   139,   138,   138,   136,
+      136,   134,   134,   133,   132,   131,   130,   129,
+      129,   127,   126,   126,   125,   124,   122,   122,
+      122,   120,   119,   119,   117,   117,   116,   115,
+      114,   113,   113,   112,   110,   110,   109,   109,
+      107,   107,   105,   105,   105,   103,   103,   101,
+      101,   101,    99,    99,    98,    97,    96,    96,
+       95,    94,    94,    92,    92,    92,    90,    90,
+};
+
+#endif /* ATAN_LUT_H */
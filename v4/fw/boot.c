@@ -0,0 +1,84 @@
+#include "boot.h"
+#include "timestamp.h"
+#include "fram.h"
+
+#include <msp430.h>
+
+#ifdef WARM_RESTART
+
+boot_info_t boot_info;
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(warm_state)
+#endif
+warm_state_t warm_state = {
+    .magic = 0,
+    .boots = 0,
+    .warm_boots = 0
+};
+
+int warm_restore(BusHandle* bus) {
+
+    // Reading the vector clears the flag, the first one has the highest priority
+    boot_info.cause = SYSRSTIV;
+    while (SYSRSTIV != SYSRSTIV_NONE)
+        ;
+
+    fram_unlock();
+
+    warm_state.boots++;
+    boot_info.warm = (boot_info.cause == SYSRSTIV_PMMSWPOR && warm_state.magic == WARM_MAGIC);
+    if (boot_info.warm) {
+        warm_state.warm_boots++;
+
+        timebase = warm_state.timebase;
+
+        bus->sync_errors = warm_state.sync_errors;
+        bus->len_errors = warm_state.len_errors;
+        bus->crc_errors = warm_state.crc_errors;
+        bus->receive_timeouts = warm_state.receive_timeouts;
+
+        sun_present = warm_state.sun_present;
+        temperature = warm_state.temperature;
+        raw = warm_state.raw;
+        position = warm_state.position;
+        sample = warm_state.sample;
+        sample.stages &= STAGE_POSITION; // Only the position is kept
+    }
+
+    // Any other reset is a cold boot
+    warm_state.magic = 0;
+
+    fram_lock();
+
+    boot_info.boots = warm_state.boots;
+    boot_info.warm_boots = warm_state.warm_boots;
+    return boot_info.warm;
+}
+
+void warm_save(const BusHandle* bus) {
+    fram_unlock();
+
+    warm_state.dco_trim = CSCTL0;
+    warm_state.ticks = get_timer_ticks();
+    warm_state.timebase = timebase;
+
+    warm_state.sync_errors = bus->sync_errors;
+    warm_state.len_errors = bus->len_errors;
+    warm_state.crc_errors = bus->crc_errors;
+    warm_state.receive_timeouts = bus->receive_timeouts;
+
+    warm_state.sun_present = sun_present;
+    warm_state.temperature = temperature;
+    warm_state.raw = raw;
+    warm_state.position = position;
+    warm_state.sample = sample;
+
+    warm_state.magic = WARM_MAGIC;
+
+    fram_lock();
+}
+
+#endif /* WARM_RESTART */
@@ -0,0 +1,63 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stdint.h>
+#include "bus.h"
+#include "calc.h"
+#include "adc.h"
+#include "sample.h"
+#include "timestamp.h"
+
+/*
+ * Warm restart: the idle reset saves the state worth keeping to FRAM, and
+ * the boot after it restores the state instead of starting from scratch.
+ * The DCO tap found by the FLL is preloaded so the clock is right at once,
+ * and the timer continues from the reset so timestamps and the local time
+ * stay valid.
+ */
+
+#define WARM_MAGIC 0x3A7E
+
+typedef struct {
+    uint16_t cause;      // SYSRSTIV of the last reset
+    uint16_t warm;       // 1 if the state was restored after an idle reset
+    uint16_t boot_ticks; // Time from platform_init() to serving the bus [1/32768 s]
+    uint16_t boots;      // Resets since programming
+    uint16_t warm_boots; // Warm restarts since programming
+} boot_info_t;
+
+typedef struct {
+    uint16_t magic;      // WARM_MAGIC if saved before an idle reset
+    uint16_t boots, warm_boots;
+    uint16_t dco_trim;   // CSCTL0 with the FLL locked
+    uint32_t ticks;      // Timer ticks at the reset
+    timebase_t timebase; // Local time base, continues with the timer
+
+    // Bus error counters
+    uint8_t sync_errors, len_errors, crc_errors, receive_timeouts;
+
+    // Eclipse detection and the last sample
+    uint8_t sun_present;
+    temperature_t temperature;
+    sample_record_t sample;
+    raw_measurements_t raw;
+    position_measurement_t position;
+} warm_state_t;
+
+extern boot_info_t boot_info;
+extern warm_state_t warm_state; // Stored in FRAM
+
+/*
+ * Read and clear the reset cause. After an idle reset the saved state is
+ * restored to the bus counters and the sampling globals.
+ * Returns 1 for a warm restart, warm_state.ticks and warm_state.dco_trim
+ * are then valid.
+ */
+int warm_restore(BusHandle* bus);
+
+/*
+ * Save the state before the idle reset.
+ */
+void warm_save(const BusHandle* bus);
+
+#endif /* __BOOT_H__ */
@@ -1,5 +1,6 @@
 #include "bus_frame.h"
 #include "bus.h"
+#include "ramfunc.h"
 
 #include <string.h> // memset
 
@@ -34,7 +35,7 @@ const uint16_t crc16_table[256] = {
 		0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641, 0x8201,
 		0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040 };
 
-uint16_t bus_crc16(const uint8_t* data, size_t len) {
+RAMFUNC uint16_t bus_crc16(const uint8_t* data, size_t len) {
 	uint16_t crc = 0xffff;
 	while (len-- > 0) {
 		uint16_t idx = crc16_table[(crc ^ *(data++)) & 0xff];
@@ -75,7 +76,7 @@ int bus_handle_rx_byte(BusHandle* self, uint8_t data) {
 		// Source address. Skip.
 	} break;
 	case 5: {
-		if (data != BUS_MY_ADDRESS) {
+		if (!BUS_FOR_ME(data)) {
 			self->rx_state = BUS_STATE_WAITING_FOR_SYNC;
 		}
 	} break;
@@ -84,7 +85,7 @@ int bus_handle_rx_byte(BusHandle* self, uint8_t data) {
 		if (self->rx_index + 1 >= self->rx_length) {
 
 			// Check destination address
-			if (self->frame_rx.dst != BUS_MY_ADDRESS) {
+			if (!BUS_FOR_ME(self->frame_rx.dst)) {
 				self->rx_state = BUS_STATE_WAITING_FOR_SYNC;
 				break;
 			}
@@ -24,6 +24,18 @@
 #define BUS_MY_ADDRESS ADCS_PSD_XP
 #endif
 
+// Broadcast frames are handled by every slave without a response
+#ifdef TIME_SYNC
+#define BUS_BROADCAST
+#endif
+
+#ifdef BUS_BROADCAST
+#define BUS_ADDRESS_BROADCAST 0x00
+#define BUS_FOR_ME(dst) ((dst) == BUS_MY_ADDRESS || (dst) == BUS_ADDRESS_BROADCAST)
+#else
+#define BUS_FOR_ME(dst) ((dst) == BUS_MY_ADDRESS)
+#endif
+
 #define BUS_SYNC_HIGH 0x5A
 #define BUS_SYNC_LOW  0xCE
 
@@ -1,4 +1,6 @@
 #include "calc.h"
+#include "fixmath.h"
+#include "ramfunc.h"
 
 raw_measurements_t raw;
 position_measurement_t position;
@@ -27,14 +29,78 @@ calibration_t calibration = {
 #pragma SET_DATA_SECTION()
 #endif
 
-void calculate_position() {
+#ifdef CALC_CORRECTION
+
+#ifdef NO_CCS
+__attribute__ ((section(".info_vars")))
+#else
+#pragma SET_DATA_SECTION(".info_vars")
+#endif
+correction_t correction = {
+    .valid = 0 // No correction until a grid is uploaded
+};
+
+#ifndef NO_CCS
+#pragma SET_DATA_SECTION()
+#endif
+
+#endif
+
+#ifdef CALC_UNIT_VECTOR
+
+unit_vector_measurement_t unit_vector;
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(mounting)
+#endif
+mounting_t mounting = {
+    .rotate = 0,
+    .m = {
+        { 32767, 0, 0 },
+        { 0, 32767, 0 },
+        { 0, 0, 32767 }
+    }
+};
+
+#endif
+
+#ifdef CALC_TRACKER
+
+track_measurement_t track;
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(tracker_config)
+#endif
+tracker_config_t tracker_config = {
+    .alpha = 128,   // 0.5
+    .beta = 43,     // ~0.17, critically damped for alpha = 0.5
+    .max_gap = 2000
+};
+
+#endif
+
+RAMFUNC void calculate_position() {
 
     int32_t sum = raw.vx1 + raw.vx2 + raw.vy1 + raw.vy2;
     int32_t a = (int32_t)(raw.vx2 + raw.vy1) - (int32_t)(raw.vx1 + raw.vy2);
     int32_t b = (int32_t)(raw.vx2 + raw.vy2) - (int32_t)(raw.vx1 + raw.vy1);
 
-    position.x = (int16_t)((a << 11) / sum); // value from -1024 to 1024
-    position.y = (int16_t)((b << 11) / sum);
+    if (sum > 0 && sum < 4096) {
+        // One reciprocal for both coordinates instead of two divisions,
+        // CMD_GET_CYCLES measures both (cycles.h)
+        fix_recip_t rc;
+        fix_recip(&rc, (uint16_t)sum);
+        position.x = fix_div_q11((int16_t)a, &rc); // value from -1024 to 1024
+        position.y = fix_div_q11((int16_t)b, &rc);
+    }
+    else {
+        // No light at all or a sampling error
+        position.x = position.y = 0;
+    }
     position.intensity = (uint16_t)(sum >> 2); // 0 - 1024
 
     // In some corner case when no sun is visible and ADCs are reporting near 0
@@ -54,52 +120,380 @@ void calculate_vectors() {
     vector.intensity = position.intensity;
 }
 
+#ifdef CALC_UNIT_VECTOR
+
+static int16_t q15_saturate(int32_t v) {
+    if (v > INT16_MAX)
+        return INT16_MAX;
+    if (v < -INT16_MAX)
+        return -INT16_MAX;
+    return (int16_t)v;
+}
+
+void calculate_unit_vector() {
+    int16_t v[3] = { -position.x, -position.y, calibration.height };
+    int16_t u[3];
+    unsigned int i, j;
+
+    uint32_t s = (uint32_t)fix_mul_s16(v[0], v[0]) + (uint32_t)fix_mul_s16(v[1], v[1]) +
+                 (uint32_t)fix_mul_s16(v[2], v[2]);
+
+    uint8_t shift;
+    uint16_t r = fix_rsqrt(s, &shift);
+    int32_t round = (1L << shift) >> 1;
+    for (i = 0; i < 3; i++)
+        u[i] = q15_saturate((fix_mul_s32_s16(r, v[i]) + round) >> shift);
+
+    if (mounting.rotate) {
+        int16_t b[3];
+        for (i = 0; i < 3; i++) {
+            fix_mac_clear();
+            for (j = 0; j < 3; j++)
+                fix_mac_s16(mounting.m[i][j], u[j]);
+            b[i] = q15_saturate((fix_mac_result() + 0x4000) >> 15);
+        }
+        unit_vector.x = b[0];
+        unit_vector.y = b[1];
+        unit_vector.z = b[2];
+    }
+    else {
+        unit_vector.x = u[0];
+        unit_vector.y = u[1];
+        unit_vector.z = u[2];
+    }
+    unit_vector.intensity = position.intensity;
+}
+
+#endif
+
+uint16_t isqrt(uint32_t x) {
+    // Bit by bit, no multiplications
+    uint32_t res = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > x)
+        bit >>= 2;
+
+    while (bit != 0) {
+        FIX_COUNT(loop);
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return (uint16_t)res;
+}
+
+/*
+ * N^2 * var = N * sum(x^2) - sum(x)^2 for each channel, the variance of the
+ * mean is var / N = w / N^3. w itself fits: 4 * 16 * 16 * 1023^2 < 2^31.
+ */
+uint32_t calculate_variance(const raw_squares_t* sq, unsigned int shift) {
+    uint32_t w = 0;
+    w += (sq->vx1 << shift) - fix_mul_u16(raw.vx1, raw.vx1);
+    w += (sq->vx2 << shift) - fix_mul_u16(raw.vx2, raw.vx2);
+    w += (sq->vy1 << shift) - fix_mul_u16(raw.vy1, raw.vy1);
+    w += (sq->vy2 << shift) - fix_mul_u16(raw.vy2, raw.vy2);
+
+    // To Q8 with the division by N^3 in the same shift
+    unsigned int div = 3 * shift;
+    if (div >= 8)
+        return w >> (div - 8);
+    if (w >= (UINT32_MAX >> (8 - div)))
+        return UINT32_MAX - 1; // UINT32_MAX is "not available"
+    return w << (8 - div);
+}
+
+uint16_t calculate_noise(uint32_t variance) {
+    uint32_t sum = (uint32_t)raw.vx1 + raw.vx2 + raw.vy1 + raw.vy2;
+    if (variance == UINT32_MAX || sum == 0 || sum > 4095)
+        return 0xFFFF;
+
+    // Every channel contributes to both coordinates with the same weight:
+    // sigma_x = 2048 * sqrt(sum of variances) / sum (sqrt of Q8 is Q4)
+    uint16_t deviation = isqrt(variance);
+    if (deviation > sum)
+        return 0xFFFE; // Over 128 LSB, no use to be more exact
+
+    fix_recip_t rc;
+    fix_recip(&rc, (uint16_t)sum);
+    return (uint16_t)fix_div_q11((int16_t)deviation, &rc);
+}
+
 
 #ifdef CALC_ANGLES
 
-#define LUT_SIZE 256
-
-const int16_t lt[LUT_SIZE] = {
-         0,    9,   18,   27,   36,   45,   54,   62,
-        71,   80,   89,   98,  106,  115,  123,  132,
-       140,  149,  157,  165,  174,  182,  190,  198,
-       206,  213,  221,  229,  236,  244,  251,  258,
-       266,  273,  280,  287,  294,  300,  307,  314,
-       320,  326,  333,  339,  345,  351,  357,  363,
-       369,  374,  380,  386,  391,  396,  402,  407,
-       412,  417,  422,  427,  432,  436,  441,  445,
-       450,  454,  459,  463,  467,  472,  476,  480,
-       484,  488,  491,  495,  499,  503,  506,  510,
-       513,  517,  520,  524,  527,  530,  533,  537,
-       540,  543,  546,  549,  552,  555,  558,  560,
-       563,  566,  569,  571,  574,  576,  579,  581,
-       584,  586,  589,  591,  593,  596,  598,  600,
-       603,  605,  607,  609,  611,  613,  615,  617,
-       619,  621,  623,  625,  627,  629,  631,  633,
+#if !defined(ANGLE_LUT) || defined(CALC_AZEL)
+
+/*
+ * CORDIC arctangent in vectoring mode.
+ * A fixed number of shift-add iterations gives a constant run time and
+ * 0.01 degree accuracy over the whole input range without a look-up table.
+ * calibration/cordic.py generates the table and sweeps the accuracy.
+ */
+#define CORDIC_ITERATIONS 16
+#define CORDIC_SHIFT 13             // Inputs are scaled to Q13
+#define CORDIC_GAIN_Q14 26981       // Magnitude gain of the iterations in Q14
+#define CORDIC_DEG90 2304000L       // 90 degrees in 1/256 centidegrees
+
+// atan(2^-i) in 1/256 centidegrees
+static const int32_t cordic_atan[CORDIC_ITERATIONS] = {
+     1152000,   680065,   359328,   182400,
+       91554,    45822,    22916,    11459,
+        5730,     2865,     1432,      716,
+         358,      179,       90,       45,
 };
 
-int16_t atan(int16_t x) {
-    x = (x >= 0) ? x : -x;
-    unsigned int pos = x >> 2;
-    if (pos >= LUT_SIZE - 1)
-        return lt[LUT_SIZE - 1];
+/*
+ * Rotate (x, y) onto the positive x axis.
+ * Returns the angle of the vector in 1/256 centidegrees and leaves the
+ * magnitude times CORDIC_GAIN in x.
+ */
+static int32_t cordic_vector(int32_t* px, int32_t y) {
+    int32_t x = *px;
+    int32_t z = 0;
 
-    // Linear interpolation from pos to pos+1 without using multiply operation
-    unsigned int y = lt[pos];
-    unsigned int d = (lt[pos + 1] + lt[pos]) >> 2;
-    unsigned int i = x - (pos << 2);
-    while (i-- > 0)
-        y += d;
+    // Pre-rotate by +-90 degrees into the right half-plane
+    if (x < 0) {
+        int32_t t = x;
+        if (y >= 0) {
+            x = y;
+            y = -t;
+            z = CORDIC_DEG90;
+        }
+        else {
+            x = -y;
+            y = t;
+            z = -CORDIC_DEG90;
+        }
+    }
+
+    unsigned int i;
+    for (i = 0; i < CORDIC_ITERATIONS; i++) {
+        FIX_COUNT(loop);
+        int32_t dx = y >> i;
+        int32_t dy = x >> i;
+        if (y >= 0) {
+            x += dx;
+            y -= dy;
+            z += cordic_atan[i];
+        }
+        else {
+            x -= dx;
+            y += dy;
+            z -= cordic_atan[i];
+        }
+    }
+
+    *px = x;
+    return z;
+}
 
-    return (x >= 0) ? (int16_t)y : -((int16_t)y);
+static int16_t cordic_centidegrees(int32_t z) {
+    return (int16_t)((z + 128) >> 8);
 }
 
+#ifndef ANGLE_LUT
+// atan2(y, x) in centidegrees
+static int16_t cordic_atan2(int16_t y, int16_t x) {
+    int32_t cx = (int32_t)x << CORDIC_SHIFT;
+    return cordic_centidegrees(cordic_vector(&cx, (int32_t)y << CORDIC_SHIFT));
+}
+#endif
+
+#endif
+
+#ifdef CALC_CORRECTION
+
+// Grid cell and Q8 weight inside the cell of a position coordinate
+static uint16_t grid_cell(int16_t p, unsigned int* cell) {
+    int16_t u = p + 1024;
+    if (u < 0)
+        u = 0;
+    else if (u > 2048)
+        u = 2048;
+
+    unsigned int c = (uint16_t)u >> CORRECTION_GRID_SHIFT;
+    uint16_t f = (uint16_t)u & ((1 << CORRECTION_GRID_SHIFT) - 1);
+    if (c == CORRECTION_GRID_N - 1) {
+        // Last node belongs to the last cell
+        c--;
+        f = 1 << CORRECTION_GRID_SHIFT;
+    }
+
+    *cell = c;
+    return f >> (CORRECTION_GRID_SHIFT - 8);
+}
+
+static int16_t lerp(int16_t a, int16_t b, uint16_t w) {
+    return a + (int16_t)((fix_mul_s16(b - a, (int16_t)w) + 128) >> 8);
+}
+
+// Bilinear interpolation of the correction grid, 6 multiplications
+static void correct_angles(void) {
+    unsigned int cx, cy;
+    uint16_t wx = grid_cell(position.x, &cx);
+    uint16_t wy = grid_cell(position.y, &cy);
+
+    const correction_node_t* n0 = &correction.node[cy][cx];
+    const correction_node_t* n1 = &correction.node[cy + 1][cx];
+
+    angles.ax += lerp(lerp(n0[0].ax, n0[1].ax, wx), lerp(n1[0].ax, n1[1].ax, wx), wy);
+    angles.ay += lerp(lerp(n0[0].ay, n0[1].ay, wx), lerp(n1[0].ay, n1[1].ay, wx), wy);
+}
+
+#endif
+
+#ifdef ANGLE_LUT
+
+/*
+ * Table based axis angles, faster than CORDIC but not constant time.
+ * atan_lut.h is generated by calibration/lut.py from the Makefile.
+ */
+#include "atan_lut.h"
+
+// Node i of the table, summed from the anchor below it
+static uint16_t atan_lut_node(unsigned int i) {
+    unsigned int j = i & ~(ATAN_LUT_ANCHOR - 1);
+    uint16_t y = atan_lut_anchor[j / ATAN_LUT_ANCHOR];
+    for (; j < i; j++) {
+        FIX_COUNT(loop);
+        y += atan_lut_delta[j];
+    }
+    return y;
+}
+
+// atan(t) for t = 0 - 1 in Q15, result in 1/2^ATAN_LUT_FRAC centidegrees
+static uint16_t atan_lut(uint16_t t) {
+    unsigned int i = t >> ATAN_LUT_SHIFT;
+    uint16_t f = t & ((1 << ATAN_LUT_SHIFT) - 1);
+    if (i == ATAN_LUT_SIZE) {
+        // t = 1 is the end of the last segment
+        i--;
+        f = 1 << ATAN_LUT_SHIFT;
+    }
+    return atan_lut_node(i) + (uint16_t)((fix_mul_u16(atan_lut_delta[i], f) + ((1UL << ATAN_LUT_SHIFT) >> 1)) >> ATAN_LUT_SHIFT);
+}
+
+// atan2(p, h) in centidegrees, reduced to the first octant
+static int16_t lut_atan2(int16_t p, int16_t h) {
+    if (h <= 0)
+        return 0; // Not calibrated
+
+    uint16_t a = (p >= 0) ? p : -p;
+    uint32_t y;
+    if (a < h)
+        y = atan_lut(fix_q15_div(a, h));
+    else if (a == h)
+        y = atan_lut(1U << 15);
+    else
+        y = (9000UL << ATAN_LUT_FRAC) - atan_lut(fix_q15_div(h, a));
+
+    int16_t r = (int16_t)((y + ((1 << ATAN_LUT_FRAC) >> 1)) >> ATAN_LUT_FRAC);
+    return (p >= 0) ? r : -r;
+}
+
+#endif
+
 void calculate_angles() {
 
-    angles.ax = atan(position.x);
-    angles.ay = atan(position.y);
+#ifdef ANGLE_LUT
+    angles.ax = lut_atan2(position.x, calibration.height);
+    angles.ay = lut_atan2(position.y, calibration.height);
+#else
+    angles.ax = cordic_atan2(position.x, calibration.height);
+    angles.ay = cordic_atan2(position.y, calibration.height);
+#endif
+#ifdef CALC_CORRECTION
+    if (correction.valid == CORRECTION_VALID)
+        correct_angles();
+#endif
 
     angles.intensity = position.intensity;
+
+#ifdef CALC_AZEL
+    // Azimuth of the sun vector (-x, -y, height)
+    int32_t r = -((int32_t)position.x << CORDIC_SHIFT);
+    angles.azimuth = cordic_centidegrees(cordic_vector(&r, -((int32_t)position.y << CORDIC_SHIFT)));
+
+    // r is now the distance of the spot from the center times the CORDIC gain,
+    // so the height gets the same gain before the elevation
+    int32_t h = fix_mul_s16(calibration.height, CORDIC_GAIN_Q14) >> (14 - CORDIC_SHIFT);
+    angles.elevation = cordic_centidegrees(cordic_vector(&r, h));
+#endif
+}
+
+#endif
+
+
+#ifdef CALC_TRACKER
+
+/*
+ * Alpha-beta tracker state.
+ * Positions are in Q8 position LSBs and velocities in Q12 position LSBs per
+ * millisecond, so that v * dt stays within 32 bits for gaps up to ~16 s.
+ */
+#define TRACKER_MAX_VELOCITY 134214L // 32767 LSB/s in Q12 per ms
+#define TRACKER_MAX_GAP 16000         // Keeps v * dt within 32 bits
+
+static struct {
+    int32_t x, y;
+    int32_t vx, vy;
+    uint16_t last;
+    uint8_t valid;
+} tracker;
+
+void reset_tracker() {
+    tracker.valid = 0;
+}
+
+static int16_t track_axis(int32_t* x, int32_t* v, int16_t meas, uint16_t dt) {
+
+    // Predict
+    *x += fix_mul_s32_s16(*v, dt) >> 4;
+
+    // Correct
+    int32_t r = ((int32_t)meas << 8) - *x;
+    *x += fix_mul_s32_s16(r, tracker_config.alpha) >> 8;
+    if (dt != 0) {
+        FIX_COUNT(div);
+        *v += (fix_mul_s32_s16(r, tracker_config.beta) >> 4) / dt;
+        if (*v > TRACKER_MAX_VELOCITY)
+            *v = TRACKER_MAX_VELOCITY;
+        else if (*v < -TRACKER_MAX_VELOCITY)
+            *v = -TRACKER_MAX_VELOCITY;
+    }
+
+    return (int16_t)((*x + 128) >> 8);
+}
+
+void update_tracker(uint16_t now) {
+
+    uint16_t dt = now - tracker.last;
+    tracker.last = now;
+
+    if (!tracker.valid || dt > tracker_config.max_gap || dt > TRACKER_MAX_GAP) {
+        // (Re)start from the current measurement
+        tracker.x = (int32_t)position.x << 8;
+        tracker.y = (int32_t)position.y << 8;
+        tracker.vx = tracker.vy = 0;
+        tracker.valid = 1;
+
+        track.x = position.x;
+        track.y = position.y;
+    }
+    else {
+        // Samples within the same timestamp tick only refine the position
+        track.x = track_axis(&tracker.x, &tracker.vx, position.x, dt);
+        track.y = track_axis(&tracker.y, &tracker.vy, position.y, dt);
+    }
+
+    track.vx = (int16_t)(fix_mul_s32_s16(tracker.vx, 1000) >> 12);
+    track.vy = (int16_t)(fix_mul_s32_s16(tracker.vy, 1000) >> 12);
+    track.intensity = position.intensity;
 }
 
 #endif
@@ -17,6 +17,11 @@ typedef struct {
     uint16_t vy2;
 } raw_measurements_t;
 
+// Sums of squares of the oversampled conversions of each channel
+typedef struct {
+    uint32_t vx1, vx2, vy1, vy2;
+} raw_squares_t;
+
 
 typedef struct {
     int16_t x;
@@ -30,14 +35,88 @@ typedef struct {
     uint16_t intensity;
 } vector_measurement_t;
 
+#ifdef CALC_UNIT_VECTOR
+
+typedef struct {
+    int16_t x, y, z; // Unit sun vector in Q15
+    uint16_t intensity;
+} unit_vector_measurement_t;
+
+typedef struct {
+    uint16_t rotate;   // Rotate the unit vector into the body frame
+    int16_t m[3][3];   // Sensor to body frame rotation matrix in Q15 [row][column]
+} mounting_t;
+
+#endif
+
 #ifdef CALC_ANGLES
 
 typedef struct {
-    int16_t ax;
-    int16_t ay;
+    int16_t ax; // Angle from the boresight along the x axis [0.01 deg]
+    int16_t ay; // Angle from the boresight along the y axis [0.01 deg]
     uint16_t intensity;
+#ifdef CALC_AZEL
+    int16_t azimuth;   // Azimuth of the sun vector, -18000 - 18000 [0.01 deg]
+    int16_t elevation; // Elevation above the sensor plane, 0 - 9000 [0.01 deg]
+#endif
 } angle_measurement_t;
 
+#ifdef CALC_CORRECTION
+
+/*
+ * Distortion correction grid for the angles.
+ * Nodes are spaced evenly over the position range -1024 - 1024 and hold the
+ * difference of the measured angles to the ideal pinhole angles at that
+ * position. The difference is smooth, so a coarse grid interpolated
+ * bilinearly keeps the accuracy of the angles. The 9x9 grid fits the 512
+ * byte information FRAM.
+ */
+#ifndef CORRECTION_GRID_N
+#define CORRECTION_GRID_N 9
+#endif
+
+#if CORRECTION_GRID_N == 9
+#define CORRECTION_GRID_SHIFT 8     // 256 position LSB between nodes
+#elif CORRECTION_GRID_N == 5
+#define CORRECTION_GRID_SHIFT 9     // 512 position LSB between nodes
+#else
+#error "CORRECTION_GRID_N must be 5 or 9"
+#endif
+
+#define CORRECTION_VALID 0xC0DE
+
+typedef struct {
+    int16_t ax, ay; // Correction added to the angles [0.01 deg]
+} correction_node_t;
+
+typedef struct {
+    uint16_t valid; // CORRECTION_VALID when all rows have been uploaded
+    correction_node_t node[CORRECTION_GRID_N][CORRECTION_GRID_N]; // [y][x]
+} correction_t;
+
+#endif
+
+#endif
+
+#ifdef CALC_TRACKER
+
+typedef struct {
+    uint16_t alpha;   // Position gain in Q8 (256 = 1.0)
+    uint16_t beta;    // Velocity gain in Q8 (256 = 1.0)
+    uint16_t max_gap; // Restart the tracker if samples are further apart [ms]
+} tracker_config_t;
+
+// Largest gain accepted by CMD_CONFIG_TRACKER, above 1.0 the filter diverges
+#define TRACKER_GAIN_MAX 256
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t vx; // Spot velocity [position LSB/s]
+    int16_t vy;
+    uint16_t intensity;
+} track_measurement_t;
+
 #endif
 
 extern raw_measurements_t raw;
@@ -49,6 +128,37 @@ extern angle_measurement_t angles;
 
 #endif
 
+#ifdef CALC_UNIT_VECTOR
+
+extern unit_vector_measurement_t unit_vector;
+extern mounting_t mounting; // Stored in FRAM
+
+#endif
+
+#ifdef CALC_TRACKER
+
+extern track_measurement_t track;
+extern tracker_config_t tracker_config; // Stored in FRAM
+
+#endif
+
+#ifdef CALC_CORRECTION
+
+#ifndef CALC_ANGLES
+#error "CALC_CORRECTION requires CALC_ANGLES"
+#endif
+
+#ifdef NO_CCS
+__attribute__ ((section(".info_vars")))
+extern correction_t correction;
+#else
+#pragma SET_DATA_SECTION(".info_vars")
+extern correction_t correction;
+#pragma SET_DATA_SECTION()
+#endif
+
+#endif
+
 #ifdef NO_CCS
 __attribute__ ((section(".fram_vars")))
 extern calibration_t calibration;
@@ -64,11 +174,37 @@ void calculate_position(void);
 // calculate sun vector
 void calculate_vectors(void);
 
+// Standard deviation of the position from the summed channel variance
+// (Q8 ADC LSB^2) of the averaged sample in raw. Result is in 1/16 position LSB.
+uint16_t calculate_noise(uint32_t variance);
+
+// Sum of the channel variances of the average of 2^shift samples in Q8 ADC LSB^2,
+// from the channel sums in raw and their sums of squares. Saturates at UINT32_MAX - 1.
+uint32_t calculate_variance(const raw_squares_t* sq, unsigned int shift);
+
+// Integer square root
+uint16_t isqrt(uint32_t x);
+
+#ifdef CALC_UNIT_VECTOR
+// calculate normalized sun vector, optionally in the body frame
+void calculate_unit_vector(void);
+
+#endif
+
 #ifdef CALC_ANGLES
-// This requires a lookup table. This will need a lot more memory.
-// calculate the sun angle
+// calculate the sun angles with CORDIC, constant run time
 void calculate_angles(void);
 
 #endif
 
+#ifdef CALC_TRACKER
+// Feed the latest position to the alpha-beta tracker.
+// now is the sample time in milliseconds.
+void update_tracker(uint16_t now);
+
+// Forget the tracker state. Next sample restarts the tracker.
+void reset_tracker(void);
+
+#endif
+
 #endif /* CALC_H */
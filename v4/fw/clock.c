@@ -0,0 +1,93 @@
+#include "clock.h"
+#include "timestamp.h"
+#include "main.h"
+#include "energy.h"
+
+#include <msp430.h>
+
+#ifdef CLOCK_SCALING
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(clock_config)
+#endif
+clock_config_t clock_config = {
+    .burst = 1
+};
+
+clock_stats_t clock_stats;
+
+uint8_t clock_profile = 0xFF; // Set by the first clock_set_profile()
+
+static uint32_t awake_since;
+
+static const struct {
+    uint16_t dividers;   // CSCTL5
+    uint16_t waits;      // FRCTL0, one wait state above 8 MHz
+    uint16_t brw, mctlw; // UART 111607 baud of the OBC, N = SMCLK / baud
+    uint16_t rx_timeout; // 0.4 ms in TB1 ticks, SMCLK / 8
+} profiles[CLOCK_PROFILES] = {
+    // SMCLK 1.999 MHz, N = 17.91
+    [CLOCK_IDLE] = { DIVM__8 | DIVS__1, NWAITS_0, 1, UCOS16 | UCBRF_1 | 0xEF00, 100 },
+    // SMCLK 7.995 MHz, N = 71.64
+    [CLOCK_BURST] = { DIVM__1 | DIVS__2, NWAITS_1, 4, UCOS16 | UCBRF_7 | 0xB600, 400 },
+};
+
+uint8_t clock_set_profile(uint8_t profile) {
+    if (profile == clock_profile)
+        return 1;
+
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    // The UART reset would lose a byte being received or not read yet, and
+    // the start edge flag, cleared by the caller with the bus idle, tells of
+    // a byte started since. The first call configures the UART anyway.
+    if (clock_profile < CLOCK_PROFILES &&
+            ((UCA0STATW & UCBUSY) || (UCA0IFG & (UCRXIFG | UCSTTIFG)))) {
+        __set_interrupt_state(state);
+        return 0;
+    }
+
+    // Awake and active time so far belong to the old profile
+    if (clock_profile < CLOCK_PROFILES)
+        clock_sleep();
+#ifdef ENERGY_STATS
+    energy_update();
+#endif
+
+    // Add the wait state before speeding up, remove it after slowing down
+    if (profiles[profile].waits)
+        FRCTL0 = FRCTLPW | profiles[profile].waits;
+    CSCTL5 = (CSCTL5 & ~(DIVM | DIVS)) | profiles[profile].dividers;
+    if (!profiles[profile].waits)
+        FRCTL0 = FRCTLPW | profiles[profile].waits;
+
+    // The software reset clears the interrupt enables
+    uint16_t ie = UCA0IE;
+    UCA0CTLW0 |= UCSWRST;
+    UCA0BRW = profiles[profile].brw;
+    UCA0MCTLW = profiles[profile].mctlw;
+    UCA0CTLW0 &= ~UCSWRST;
+    UCA0IE = ie;
+
+    bus_rx_timeout = profiles[profile].rx_timeout;
+
+    clock_profile = profile;
+    clock_wake();
+    __set_interrupt_state(state);
+    return 1;
+}
+
+void clock_sleep() {
+    uint32_t now = get_timer_ticks();
+    clock_stats.awake[clock_profile] += now - awake_since;
+    awake_since = now;
+}
+
+void clock_wake() {
+    awake_since = get_timer_ticks();
+}
+
+#endif /* CLOCK_SCALING */
@@ -0,0 +1,50 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <stdint.h>
+
+/*
+ * Clock profiles. The FLL keeps DCOCLKDIV locked at 16 MHz and a profile
+ * only changes the MCLK and SMCLK dividers, so switching takes effect at
+ * once. The UART baud rate, the RX timeout (TB1) and the FRAM wait states
+ * are reprogrammed with the profile. TB0 and the ADC run from ACLK and
+ * are not affected.
+ */
+#define CLOCK_IDLE      0 // MCLK = SMCLK = 2 MHz
+#define CLOCK_BURST     1 // MCLK = 16 MHz, SMCLK = 8 MHz
+#define CLOCK_PROFILES  2
+
+typedef struct {
+    uint16_t burst; // Handle bus requests in the burst profile
+} clock_config_t;
+
+/*
+ * Time awake in each profile, measured by the scheduler idle hook and
+ * including the ADC conversion waits, and the bus requests handled in
+ * each profile. Energy per request = awake time / requests * supply
+ * current of the profile.
+ */
+typedef struct {
+    uint32_t awake[CLOCK_PROFILES];    // [1/32768 s]
+    uint16_t requests[CLOCK_PROFILES];
+} clock_stats_t;
+
+extern clock_config_t clock_config; // Stored in FRAM
+extern clock_stats_t clock_stats;
+extern uint8_t clock_profile;
+
+/*
+ * Switch the clock profile between frames. The caller clears UCSTTIFG once
+ * it has found the bus idle: if a byte has started since, or one is still
+ * being received or not read, the UART is not touched and 0 is returned.
+ */
+uint8_t clock_set_profile(uint8_t profile);
+
+/*
+ * Awake time accounting, called around the low-power modes. Spin mode does
+ * not idle between its samples, its time counts as awake.
+ */
+void clock_sleep(void);
+void clock_wake(void);
+
+#endif /* __CLOCK_H__ */
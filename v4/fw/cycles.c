@@ -0,0 +1,136 @@
+#include "cycles.h"
+#include "calc.h"
+#include "clock.h"
+#include "fixmath.h"
+#include "bus_frame.h"
+
+#include <msp430.h>
+
+#ifdef PROFILER
+
+// Operands and results, volatile so the loops keep every call
+static volatile int16_t in_a, in_b;
+static volatile int32_t in_32;
+static volatile uint32_t sink;
+
+// A sun spot off the center, sum 1450 normalizes with one shift
+static const raw_measurements_t spot = { 300, 420, 350, 380 };
+
+static const uint8_t crc_frame[16] = {
+    0x5A, 0xCE, 0x00, 0x09, 0x01, 0xA5, 0x03, 0x10,
+    0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90
+};
+
+static fix_recip_t rc;
+
+// calculate_position() before the reciprocal, two 32-bit divisions
+static void position_divide(void) {
+    int32_t sum = raw.vx1 + raw.vx2 + raw.vy1 + raw.vy2;
+    int32_t a = (int32_t)(raw.vx2 + raw.vy1) - (int32_t)(raw.vx1 + raw.vy2);
+    int32_t b = (int32_t)(raw.vx2 + raw.vy2) - (int32_t)(raw.vx1 + raw.vy1);
+
+    position.x = (int16_t)((a << 11) / sum);
+    position.y = (int16_t)((b << 11) / sum);
+    position.intensity = (uint16_t)(sum >> 2);
+    if (position.intensity > 1024)
+        position.intensity = 0;
+
+    position.x += calibration.offset_x;
+    position.y += calibration.offset_y;
+}
+
+// Ticks of CYCLES_CALLS runs of call
+#define TIME_CALLS(ticks, call) do { \
+        uint16_t start = TB1R; \
+        for (unsigned int i = 0; i < CYCLES_CALLS; i++) { \
+            call; \
+        } \
+        ticks = TB1R - start; \
+    } while (0)
+
+#define MEASURE(kernel, call) do { \
+        uint16_t ticks; \
+        TIME_CALLS(ticks, call); \
+        report->cycles[kernel] = ticks > overhead ? (uint32_t)(ticks - overhead) * cycles_per_tick : 0; \
+    } while (0)
+
+void cycles_measure(cycles_report_t* report) {
+    raw_measurements_t saved_raw = raw;
+    position_measurement_t saved_position = position;
+#ifdef CALC_ANGLES
+    angle_measurement_t saved_angles = angles;
+#endif
+#ifdef CALC_UNIT_VECTOR
+    unit_vector_measurement_t saved_unit_vector = unit_vector;
+#endif
+
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    // The timer counts SMCLK / 8, MCLK runs 2^DIVS times faster
+    uint16_t cycles_per_tick = 8 << ((CSCTL5 & DIVS) >> 4);
+
+    in_a = -1234;
+    in_b = 5678;
+    in_32 = 0x12345678;
+    fix_recip(&rc, 1450);
+    raw = spot;
+
+    // Loop with the operand reads and the result write only
+    uint16_t overhead;
+    TIME_CALLS(overhead, sink = in_a + in_b);
+
+    report->calls = CYCLES_CALLS;
+#ifdef CLOCK_SCALING
+    report->clock = clock_profile;
+#else
+    report->clock = 0;
+#endif
+#ifdef FIXMATH_MPY32
+    report->software = 0;
+#else
+    report->software = 1;
+#endif
+
+    MEASURE(CYC_MUL_U16, sink = fix_mul_u16(in_a, in_b));
+    MEASURE(CYC_MUL_S16, sink = fix_mul_s16(in_a, in_b));
+    MEASURE(CYC_MUL_S32_S16, sink = fix_mul_s32_s16(in_32, in_b));
+    MEASURE(CYC_Q15_MUL, sink = fix_q15_mul(in_a, in_b));
+    fix_mac_clear();
+    MEASURE(CYC_MAC_S16, fix_mac_s16(in_a, in_b));
+    sink = fix_mac_result();
+    MEASURE(CYC_Q31_MUL, sink = fix_q31_mul(in_32, in_32));
+    MEASURE(CYC_RECIP, fix_recip(&rc, in_b & 0x0FFF));
+    fix_recip(&rc, 1450);
+    MEASURE(CYC_DIV_Q11, sink = fix_div_q11(in_a, &rc));
+    MEASURE(CYC_Q15_DIV, sink = fix_q15_div(in_a, in_b));
+    uint8_t shift;
+    MEASURE(CYC_RSQRT, sink = fix_rsqrt(in_32, &shift));
+
+    MEASURE(CYC_POSITION, calculate_position());
+    MEASURE(CYC_POSITION_DIV, position_divide());
+#ifdef CALC_ANGLES
+    MEASURE(CYC_ANGLES, calculate_angles());
+#else
+    report->cycles[CYC_ANGLES] = 0;
+#endif
+#ifdef CALC_UNIT_VECTOR
+    MEASURE(CYC_UNIT_VECTOR, calculate_unit_vector());
+#else
+    report->cycles[CYC_UNIT_VECTOR] = 0;
+#endif
+    MEASURE(CYC_CRC16, sink = bus_crc16(crc_frame, sizeof(crc_frame)));
+
+    __set_interrupt_state(state);
+
+    raw = saved_raw;
+    position = saved_position;
+#ifdef CALC_ANGLES
+    angles = saved_angles;
+#endif
+#ifdef CALC_UNIT_VECTOR
+    unit_vector = saved_unit_vector;
+#endif
+}
+
+#endif /* PROFILER */
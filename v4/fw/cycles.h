@@ -0,0 +1,62 @@
+#ifndef __CYCLES_H__
+#define __CYCLES_H__
+
+#include <stdint.h>
+
+/*
+ * Cycle counts of the fixed-point primitives and the calc kernels on the
+ * target, for the tables in platform/fixmath.h. With PROFILER only.
+ *
+ * Each kernel is called CYCLES_CALLS times in a loop with interrupts
+ * disabled and timed with Timer B1. The operands are read from volatile
+ * variables and the results written to one, and the time of the same loop
+ * with the operands only moved to the result is subtracted, so the counts
+ * hold the kernel and its call. The kernels run on one fixed sun spot,
+ * data dependent loops (normalization, rounding checks) take that path.
+ *
+ * Ticks are converted to MCLK cycles with the SMCLK divider, 8 << DIVS
+ * cycles per tick (the timer counts SMCLK / 8), so the resolution is
+ * 8 << DIVS / CYCLES_CALLS cycles.
+ *
+ * Builds with FIXMATH_SOFTWARE run the primitives without MPY32, for the
+ * software column. The measurement takes up to 0.3 s in the idle clock
+ * profile. tools/cycles.py reads and prints the table.
+ */
+
+#define CYCLES_CALLS    16
+
+/* Kernels */
+#define CYC_MUL_U16         0  // fix_mul_u16()
+#define CYC_MUL_S16         1  // fix_mul_s16()
+#define CYC_MUL_S32_S16     2  // fix_mul_s32_s16()
+#define CYC_Q15_MUL         3  // fix_q15_mul()
+#define CYC_MAC_S16         4  // fix_mac_s16()
+#define CYC_Q31_MUL         5  // fix_q31_mul()
+#define CYC_RECIP           6  // fix_recip()
+#define CYC_DIV_Q11         7  // fix_div_q11()
+#define CYC_Q15_DIV         8  // fix_q15_div()
+#define CYC_RSQRT           9  // fix_rsqrt()
+#define CYC_POSITION        10 // calculate_position()
+#define CYC_POSITION_DIV    11 // calculate_position() with two 32-bit divisions, before the reciprocal
+#define CYC_ANGLES          12 // calculate_angles(), 0 without CALC_ANGLES
+#define CYC_UNIT_VECTOR     13 // calculate_unit_vector(), 0 without CALC_UNIT_VECTOR
+#define CYC_CRC16           14 // bus_crc16() of a 16-byte frame
+#define CYC_KERNELS         15
+
+typedef struct {
+    uint16_t calls;                // Calls of each kernel
+    uint8_t clock;                 // Clock profile, 0 without CLOCK_SCALING
+    uint8_t software;              // 1 if built with FIXMATH_SOFTWARE or without MPY32
+    uint32_t cycles[CYC_KERNELS];  // MCLK cycles of all calls
+} cycles_report_t;
+
+#ifdef PROFILER
+
+/*
+ * Measure all kernels. The sample globals are restored afterwards.
+ */
+void cycles_measure(cycles_report_t* report);
+
+#endif
+
+#endif /* __CYCLES_H__ */
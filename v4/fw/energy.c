@@ -0,0 +1,111 @@
+#include "energy.h"
+#include "timestamp.h"
+#include "clock.h"
+
+#include <msp430.h>
+
+#ifdef ENERGY_STATS
+
+energy_stats_t energy_stats;
+energy_command_t energy_commands[ENERGY_COMMANDS];
+
+static uint8_t power_mode = POWER_ACTIVE;
+static uint8_t afe_on;
+static uint32_t mode_since, afe_since;
+
+// Snapshot of energy_stats at the start of a command
+static energy_stats_t command_start;
+
+// Energy per timer tick in 1/256 nJ: I [uA] * U [mV] / 32768 * 256
+#define NJ_PER_TICK(ua)     ((uint16_t)((uint32_t)(ua) * ENERGY_SUPPLY_MV / 128))
+
+static const uint16_t mode_nj[POWER_MODES] = {
+#ifdef CLOCK_SCALING
+    [POWER_ACTIVE] = 0, // Charged per clock profile
+#else
+    [POWER_ACTIVE] = NJ_PER_TICK(ENERGY_ACTIVE_UA),
+#endif
+    [POWER_LPM0] = NJ_PER_TICK(ENERGY_LPM0_UA),
+    [POWER_LPM3] = NJ_PER_TICK(ENERGY_LPM3_UA),
+};
+
+#ifdef CLOCK_SCALING
+static const uint16_t active_nj[CLOCK_PROFILES] = {
+    [CLOCK_IDLE] = NJ_PER_TICK(ENERGY_IDLE_UA),
+    [CLOCK_BURST] = NJ_PER_TICK(ENERGY_ACTIVE_UA),
+};
+#endif
+
+_Static_assert((uint32_t)ENERGY_ACTIVE_UA * ENERGY_SUPPLY_MV / 128 <= UINT16_MAX, "active current too high");
+
+// Interrupts must be disabled
+static void flush(void) {
+    uint32_t now = get_timer_ticks();
+
+    energy_stats.time[power_mode] += now - mode_since;
+#ifdef CLOCK_SCALING
+    if (power_mode == POWER_ACTIVE && clock_profile < CLOCK_PROFILES)
+        energy_stats.active[clock_profile] += now - mode_since;
+#endif
+    mode_since = now;
+
+    if (afe_on)
+        energy_stats.afe += now - afe_since;
+    afe_since = now;
+}
+
+void energy_init() {
+    mode_since = afe_since = get_timer_ticks();
+}
+
+void energy_mode(uint8_t mode) {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+    flush();
+    power_mode = mode;
+    __set_interrupt_state(state);
+}
+
+void energy_afe(uint8_t on) {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+    flush();
+    afe_on = on;
+    __set_interrupt_state(state);
+}
+
+void energy_update() {
+    energy_mode(power_mode);
+}
+
+void energy_command_start() {
+    energy_update();
+    command_start = energy_stats;
+}
+
+void energy_command_end(uint8_t cmd) {
+    energy_update();
+
+    // The times of a command are far below the 2 s of a 16-bit tick count
+    uint32_t nj = 0;
+    for (uint8_t i = 0; i < POWER_MODES; i++)
+        nj += (uint32_t)(uint16_t)(energy_stats.time[i] - command_start.time[i]) * mode_nj[i];
+#ifdef CLOCK_SCALING
+    for (uint8_t i = 0; i < CLOCK_PROFILES; i++)
+        nj += (uint32_t)(uint16_t)(energy_stats.active[i] - command_start.active[i]) * active_nj[i];
+#endif
+    nj += (uint32_t)(uint16_t)(energy_stats.afe - command_start.afe) * NJ_PER_TICK(ENERGY_AFE_UA);
+    nj >>= 8;
+    if (nj > UINT16_MAX)
+        nj = UINT16_MAX;
+
+    energy_command_t* entry = &energy_commands[cmd < ENERGY_COMMANDS ? cmd : 0];
+    if (entry->count == 0)
+        entry->energy = (uint16_t)nj;
+    else
+        entry->energy += ((int32_t)nj - entry->energy) >> 3;
+    if (entry->count < UINT16_MAX)
+        entry->count++;
+}
+
+#endif /* ENERGY_STATS */
@@ -0,0 +1,91 @@
+#ifndef __ENERGY_H__
+#define __ENERGY_H__
+
+#include <stdint.h>
+#include "clock.h"
+
+/*
+ * Energy accounting. The time in each power mode and with the analog
+ * front end (opamp, reference, temperature sensor and ADC) powered is
+ * accumulated from Timer B0 snapshots at every transition. Interrupts
+ * are counted to the mode they interrupted.
+ *
+ * With CLOCK_SCALING the active time is also kept per clock profile,
+ * clock_set_profile() brings it up to date before switching, and each
+ * profile is charged its own active current.
+ *
+ * The energy of each command is estimated from the times spent while
+ * handling it and the supply currents below. The currents are estimates
+ * from the datasheet, replace them with measurements of the board.
+ */
+#define POWER_ACTIVE    0
+#define POWER_LPM0      1
+#define POWER_LPM3      2
+#define POWER_MODES     3
+
+#define ENERGY_SUPPLY_MV    3300
+#ifdef CLOCK_SCALING
+#define ENERGY_ACTIVE_UA    2000 // 16 MHz, burst profile
+#define ENERGY_IDLE_UA      500  // 2 MHz, idle profile, the DCO still runs at 16 MHz
+#else
+#define ENERGY_ACTIVE_UA    1000 // 8 MHz
+#endif
+#define ENERGY_LPM0_UA      200
+#define ENERGY_LPM3_UA      15   // REFO for ACLK
+#define ENERGY_AFE_UA       400
+
+// Command codes with their own entry, others share entry 0
+#define ENERGY_COMMANDS     16
+
+typedef struct {
+    uint32_t time[POWER_MODES];  // [1/32768 s]
+    uint32_t afe;                // Analog front end powered [1/32768 s]
+#ifdef CLOCK_SCALING
+    uint32_t active[CLOCK_PROFILES]; // Active time of each clock profile [1/32768 s]
+#endif
+} energy_stats_t;
+
+typedef struct {
+    uint16_t count;              // Handled commands, saturates
+    uint16_t energy;             // Running mean over 8 commands [nJ]
+} energy_command_t;
+
+#ifdef ENERGY_STATS
+
+extern energy_stats_t energy_stats;
+extern energy_command_t energy_commands[ENERGY_COMMANDS];
+
+#define ENERGY_MODE(mode)   energy_mode(mode)
+#define ENERGY_AFE(on)      energy_afe(on)
+
+/*
+ * Start the accounting from the current time.
+ */
+void energy_init(void);
+
+/*
+ * Transition to a power mode or of the analog front end.
+ * Safe to call from interrupts.
+ */
+void energy_mode(uint8_t mode);
+void energy_afe(uint8_t on);
+
+/*
+ * Bring energy_stats up to date.
+ */
+void energy_update(void);
+
+/*
+ * Account the energy of a command from the start to the end call.
+ */
+void energy_command_start(void);
+void energy_command_end(uint8_t cmd);
+
+#else
+
+#define ENERGY_MODE(mode)
+#define ENERGY_AFE(on)
+
+#endif /* ENERGY_STATS */
+
+#endif /* __ENERGY_H__ */
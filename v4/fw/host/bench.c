@@ -0,0 +1,236 @@
+/*
+ * Host benchmark and accuracy harness for the calc.c kernels.
+ *
+ * Sweeps the 10-bit raw_measurements_t space with a stratified grid,
+ * runs every kernel and compares it to a double precision reference.
+ * Prints the max and RMS error, operations per call counted by fixmath
+ * (software fallback) and the host throughput. Exits with an error if a
+ * kernel exceeds its error limit.
+ *
+ * Usage: bench [step]
+ *   step  Grid step of every channel, default 32 (1M samples). 1 would be
+ *         the exhaustive sweep of 2^40 samples.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "calc.h"
+#include "fixmath.h"
+
+#define ADC_MAX 1023
+#define CENTIDEGREES (18000.0 / M_PI)
+
+typedef struct {
+    const char* name;
+    double limit;   // Maximum allowed error
+    double max_err, sum_sq;
+    uint32_t n;
+    fix_counters_t total, max;
+    double ns;
+} kernel_stats_t;
+
+static void add_error(kernel_stats_t* k, double err) {
+    err = fabs(err);
+    if (err > k->max_err)
+        k->max_err = err;
+    k->sum_sq += err * err;
+    k->n++;
+}
+
+static void add_ops(kernel_stats_t* k) {
+    k->total.mul += fix_counters.mul;
+    k->total.div += fix_counters.div;
+    k->total.loop += fix_counters.loop;
+    if (fix_counters.mul > k->max.mul)
+        k->max.mul = fix_counters.mul;
+    if (fix_counters.div > k->max.div)
+        k->max.div = fix_counters.div;
+    if (fix_counters.loop > k->max.loop)
+        k->max.loop = fix_counters.loop;
+}
+
+#define RUN(k, call) do { \
+        fix_counters = (fix_counters_t){ 0, 0, 0 }; \
+        call; \
+        add_ops(k); \
+    } while (0)
+
+static int print_stats(const kernel_stats_t* k, uint32_t calls, const char* unit) {
+    int fail = k->max_err > k->limit;
+    printf("%-14s max %9.4f  rms %9.4f %-6s | ops/call mul %5.1f (%3u) div %4.1f (%u) loop %5.1f (%3u) | %7.1f ns/call\n",
+           k->name, k->max_err, k->n ? sqrt(k->sum_sq / k->n) : 0.0, unit,
+           (double)k->total.mul / calls, (unsigned)k->max.mul,
+           (double)k->total.div / calls, (unsigned)k->max.div,
+           (double)k->total.loop / calls, (unsigned)k->max.loop,
+           k->ns);
+    if (fail)
+        printf("%-14s FAIL: max error over %g %s\n", k->name, k->limit, unit);
+    return fail;
+}
+
+static int next_raw(unsigned int step) {
+    if ((raw.vx1 += step) <= ADC_MAX)
+        return 1;
+    raw.vx1 = 0;
+    if ((raw.vx2 += step) <= ADC_MAX)
+        return 1;
+    raw.vx2 = 0;
+    if ((raw.vy1 += step) <= ADC_MAX)
+        return 1;
+    raw.vy1 = 0;
+    if ((raw.vy2 += step) <= ADC_MAX)
+        return 1;
+    return 0;
+}
+
+// Mean time of one kernel over the sweep. Includes the counter increments.
+static double time_kernel(unsigned int step, void (*kernel)(void)) {
+    uint32_t n = 0;
+    raw = (raw_measurements_t){ 0, 0, 0, 0 };
+    clock_t start = clock();
+    do {
+        calculate_position();
+        if (kernel)
+            kernel();
+        n++;
+    } while (next_raw(step));
+    return 1e9 * (double)(clock() - start) / CLOCKS_PER_SEC / n;
+}
+
+/*
+ * Variance of the oversampled mean for every sample count: each channel has
+ * k of the n samples at hi and the rest at lo, over a grid of levels that
+ * includes the full scale variance (0 and ADC_MAX, half each).
+ */
+static uint32_t bench_variance(kernel_stats_t* k, unsigned int step) {
+    uint32_t calls = 0;
+    clock_t start = clock();
+    for (unsigned int shift = 1; (1u << shift) <= 16; shift++) {
+        uint32_t n = 1u << shift;
+        for (uint32_t lo = 0; lo <= ADC_MAX; lo = (lo == ADC_MAX || lo + step < ADC_MAX) ? lo + step : ADC_MAX) {
+            for (uint32_t hi = 0; hi <= ADC_MAX; hi = (hi == ADC_MAX || hi + step < ADC_MAX) ? hi + step : ADC_MAX) {
+                for (uint32_t c = 0; c <= n; c++) {
+                    uint16_t sum = (uint16_t)(c * hi + (n - c) * lo);
+                    uint32_t sq = c * hi * hi + (n - c) * lo * lo;
+                    raw = (raw_measurements_t){ sum, sum, sum, sum };
+                    raw_squares_t squares = { sq, sq, sq, sq };
+
+                    uint32_t variance;
+                    RUN(k, variance = calculate_variance(&squares, shift));
+                    calls++;
+
+                    double mean = (double)sum / n;
+                    double var = (double)sq / n - mean * mean;
+                    add_error(k, variance / 256.0 - 4 * var / n);
+                }
+            }
+        }
+    }
+    k->ns = 1e9 * (double)(clock() - start) / CLOCKS_PER_SEC / calls;
+    return calls;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int step = (argc > 1) ? (unsigned int)atoi(argv[1]) : 32;
+    if (step == 0)
+        step = 32;
+
+    kernel_stats_t k_position = { .name = "position", .limit = 1.0 };
+    kernel_stats_t k_vector = { .name = "vector", .limit = 0.0 };
+#ifdef CALC_ANGLES
+    kernel_stats_t k_angles = { .name = "angles", .limit = 0.01 };
+#ifdef CALC_AZEL
+    kernel_stats_t k_azel = { .name = "azimuth/elev", .limit = 0.01 };
+#endif
+#endif
+#ifdef CALC_UNIT_VECTOR
+    kernel_stats_t k_unit = { .name = "unit vector", .limit = 8.0 };
+#endif
+
+    uint32_t calls = 0;
+    raw = (raw_measurements_t){ 0, 0, 0, 0 };
+    do {
+        calls++;
+        double sum = (double)raw.vx1 + raw.vx2 + raw.vy1 + raw.vy2;
+
+        RUN(&k_position, calculate_position());
+        if (sum > 0) {
+            double a = (double)raw.vx2 + raw.vy1 - raw.vx1 - raw.vy2;
+            double b = (double)raw.vx2 + raw.vy2 - raw.vx1 - raw.vy1;
+            add_error(&k_position, position.x - (2048.0 * a / sum + calibration.offset_x));
+            add_error(&k_position, position.y - (2048.0 * b / sum + calibration.offset_y));
+        }
+
+        // The remaining kernels are compared against the exact result
+        // from the fixed-point position they were given
+        double x = position.x, y = position.y, h = calibration.height;
+
+        RUN(&k_vector, calculate_vectors());
+        add_error(&k_vector, vector.x + x);
+        add_error(&k_vector, vector.y + y);
+        add_error(&k_vector, vector.z - h);
+
+#ifdef CALC_ANGLES
+        RUN(&k_angles, calculate_angles());
+        add_error(&k_angles, angles.ax / 100.0 - atan2(x, h) * CENTIDEGREES / 100.0);
+        add_error(&k_angles, angles.ay / 100.0 - atan2(y, h) * CENTIDEGREES / 100.0);
+#ifdef CALC_AZEL
+        k_azel.total = k_angles.total;
+        k_azel.max = k_angles.max;
+        if (x != 0 || y != 0) {
+            double err = angles.azimuth / 100.0 - atan2(-y, -x) * CENTIDEGREES / 100.0;
+            if (err > 180.0)
+                err -= 360.0;
+            else if (err < -180.0)
+                err += 360.0;
+            add_error(&k_azel, err);
+        }
+        add_error(&k_azel, angles.elevation / 100.0 - atan2(h, hypot(x, y)) * CENTIDEGREES / 100.0);
+#endif
+#endif
+
+#ifdef CALC_UNIT_VECTOR
+        RUN(&k_unit, calculate_unit_vector());
+        double norm = sqrt(x * x + y * y + h * h) / 32768.0;
+        add_error(&k_unit, unit_vector.x + x / norm);
+        add_error(&k_unit, unit_vector.y + y / norm);
+        add_error(&k_unit, unit_vector.z - h / norm);
+#endif
+    } while (next_raw(step));
+
+    // Throughput of each kernel alone, position is needed by all of them
+    k_position.ns = time_kernel(step, NULL);
+    k_vector.ns = time_kernel(step, calculate_vectors) - k_position.ns;
+#ifdef CALC_ANGLES
+    k_angles.ns = time_kernel(step, calculate_angles) - k_position.ns;
+#ifdef CALC_AZEL
+    k_azel.ns = k_angles.ns;
+#endif
+#endif
+#ifdef CALC_UNIT_VECTOR
+    k_unit.ns = time_kernel(step, calculate_unit_vector) - k_position.ns;
+#endif
+
+    kernel_stats_t k_variance = { .name = "variance", .limit = 0.01 };
+    uint32_t variance_calls = bench_variance(&k_variance, step);
+
+    printf("%u samples, channel step %u, height %d\n", (unsigned)calls, step, calibration.height);
+    int fail = 0;
+    fail |= print_stats(&k_position, calls, "LSB");
+    fail |= print_stats(&k_vector, calls, "LSB");
+#ifdef CALC_ANGLES
+    fail |= print_stats(&k_angles, calls, "deg");
+#ifdef CALC_AZEL
+    fail |= print_stats(&k_azel, calls, "deg");
+#endif
+#endif
+#ifdef CALC_UNIT_VECTOR
+    fail |= print_stats(&k_unit, calls, "Q15");
+#endif
+    fail |= print_stats(&k_variance, variance_calls, "LSB^2");
+
+    return fail;
+}
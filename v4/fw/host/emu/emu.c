@@ -0,0 +1,297 @@
+/*
+ * Firmware-in-the-loop emulator of the v4 sun sensor.
+ *
+ * Runs the firmware natively against the simulated peripherals of sim.c
+ * and exposes its bus on a pseudo-terminal, so host tools talk to it byte
+ * for byte like to a sensor on a serial port.
+ *
+ * Resets: the firmware runs in a child process. A software POR/BOR or a
+ * watchdog timeout ends the child, and a new one starts from the pristine
+ * RAM image of this process, as after a power-on reset.
+ *
+ * FRAM: the variables the linker places in FRAM (.persistent, .fram_vars)
+ * and in the information memory (.info_vars) are on pages of their own
+ * (fram.ld), shared between the children so they survive resets and
+ * optionally backed by a file so they survive the emulator too. The pages
+ * are read-only while SYSCFG0 write protects them: a write with the
+ * protection enabled is reported and aborts the emulator (the device would
+ * silently drop it). On x86-64 every write is checked, elsewhere the pages
+ * stay writable until the next interrupt point once unlocked.
+ *
+ * Usage: emu [-s spot] [-n noise] [-f fram] [-l link]
+ *   -s spot   Light spot script (spot.c), default a centered spot
+ *   -n noise  Conversion noise [LSB rms], default 0.5
+ *   -f fram   Keep the FRAM contents in this file
+ *   -l link   Symlink to the pty, e.g. /tmp/psd
+ */
+
+#define _GNU_SOURCE // ptsname, memfd_create
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <msp430.h>
+#include "emu.h"
+
+// Exit status of a child reset with cause
+#define EXIT_RESET  64
+
+int fw_main(void);
+
+int emu_pty = -1;
+
+volatile uint16_t SYSCFG0 = PFWP | DFWP;
+
+static struct timespec start;
+
+sim_time_t emu_clock(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (sim_time_t)(t.tv_sec - start.tv_sec) * SIM_NS + t.tv_nsec - start.tv_nsec;
+}
+
+void emu_reset(uint16_t cause) {
+    _exit(EXIT_RESET + cause);
+}
+
+static const char* reset_name(uint16_t cause) {
+    switch (cause) {
+    case SYSRSTIV_PMMSWPOR: return "software POR";
+    case SYSRSTIV_PMMSWBOR: return "software BOR";
+    case SYSRSTIV_WDTTO: return "watchdog timeout";
+    default: return "reset";
+    }
+}
+
+/*
+ * FRAM write protection
+ */
+extern char __emu_fram_start[], __emu_fram_end[];
+extern char __emu_info_start[], __emu_info_end[];
+
+static struct {
+    const char* name;
+    char *start, *end;
+    uint16_t protect;           // SYSCFG0 bit
+    volatile uint8_t writable;
+} fram[] = {
+    { "FRAM", __emu_fram_start, __emu_fram_end, PFWP },
+    { "information memory", __emu_info_start, __emu_info_end, DFWP },
+};
+
+#define FRAM_REGIONS (int)(sizeof(fram) / sizeof(fram[0]))
+
+static int fram_region(const void* addr) {
+    for (int i = 0; i < FRAM_REGIONS; i++) {
+        if ((const char*)addr >= fram[i].start && (const char*)addr < fram[i].end)
+            return i;
+    }
+    return -1;
+}
+
+static void fram_protect(int i, int writable) {
+    if (fram[i].end > fram[i].start)
+        mprotect(fram[i].start, fram[i].end - fram[i].start, writable ? PROT_READ | PROT_WRITE : PROT_READ);
+    fram[i].writable = writable;
+}
+
+void fram_sync(void) {
+    for (int i = 0; i < FRAM_REGIONS; i++) {
+        if (fram[i].writable && (SYSCFG0 & fram[i].protect))
+            fram_protect(i, 0);
+    }
+}
+
+static void fram_fault(int sig, siginfo_t* info, void* context) {
+    int i = fram_region(info->si_addr);
+    if (i < 0) {
+        // Not a FRAM write, crash on return
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    if (SYSCFG0 & fram[i].protect) {
+        void* pc = NULL;
+#if defined(__x86_64__)
+        pc = (void*)((ucontext_t*)context)->uc_mcontext.gregs[REG_RIP];
+#endif
+        char msg[160];
+        int len = snprintf(msg, sizeof(msg), "FRAM write protection violation: write to %s at %p, pc %p\n",
+                           fram[i].name, info->si_addr, pc);
+        if (write(STDERR_FILENO, msg, len) < 0)
+            ;
+        abort();
+    }
+
+    fram_protect(i, 1);
+#if defined(__x86_64__)
+    // Trap after the write to protect the region again
+    ((ucontext_t*)context)->uc_mcontext.gregs[REG_EFL] |= 0x100;
+#endif
+}
+
+#if defined(__x86_64__)
+static void fram_trap(int sig, siginfo_t* info, void* context) {
+    ((ucontext_t*)context)->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+    for (int i = 0; i < FRAM_REGIONS; i++) {
+        if (fram[i].writable)
+            fram_protect(i, 0);
+    }
+}
+#endif
+
+/*
+ * Move the FRAM regions to shared pages of the file, or of an anonymous
+ * file. A file of another size is initialized from the firmware image.
+ */
+static int fram_init(const char* path) {
+    size_t size = 0;
+    for (int i = 0; i < FRAM_REGIONS; i++)
+        size += fram[i].end - fram[i].start;
+
+    int fd = path ? open(path, O_RDWR | O_CREAT, 0644) : memfd_create("fram", 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path ? path : "fram");
+        return -1;
+    }
+
+    int load = (path && (size_t)st.st_size == size);
+    if (!load && ftruncate(fd, size) < 0) {
+        perror("fram");
+        return -1;
+    }
+
+    off_t offset = 0;
+    for (int i = 0; i < FRAM_REGIONS; i++) {
+        size_t len = fram[i].end - fram[i].start;
+        if (len == 0)
+            continue;
+        if (!load && pwrite(fd, fram[i].start, len, offset) != (ssize_t)len) {
+            perror("fram");
+            return -1;
+        }
+        if (mmap(fram[i].start, len, PROT_READ, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+            perror("fram");
+            return -1;
+        }
+        offset += len;
+    }
+    close(fd);
+
+    struct sigaction sa = { 0 };
+    sa.sa_sigaction = fram_fault;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &sa, NULL);
+#if defined(__x86_64__)
+    sa.sa_sigaction = fram_trap;
+    sigaction(SIGTRAP, &sa, NULL);
+#endif
+    return 0;
+}
+
+/*
+ * Pseudo-terminal of the bus. The slave is kept open so the master does
+ * not see a hangup while no tool is connected.
+ */
+static int pty_open(const char* link) {
+    emu_pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (emu_pty < 0 || grantpt(emu_pty) < 0 || unlockpt(emu_pty) < 0) {
+        perror("pty");
+        return -1;
+    }
+
+    const char* name = ptsname(emu_pty);
+    int slave = open(name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave < 0 || tcgetattr(slave, &tio) < 0) {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(emu_pty, F_SETFL, O_NONBLOCK);
+
+    if (link) {
+        unlink(link);
+        if (symlink(name, link) < 0) {
+            perror(link);
+            return -1;
+        }
+        name = link;
+    }
+    printf("%s\n", name);
+    fflush(stdout);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: emu [-s spot] [-n noise] [-f fram] [-l link]\n");
+    exit(2);
+}
+
+int main(int argc, char* argv[]) {
+    const char *fram_path = NULL, *link = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:f:l:h")) != -1) {
+        switch (opt) {
+        case 's':
+            if (spot_load(optarg) < 0)
+                return 1;
+            break;
+        case 'n': spot_noise = atof(optarg); break;
+        case 'f': fram_path = optarg; break;
+        case 'l': link = optarg; break;
+        default: usage();
+        }
+    }
+    if (optind != argc)
+        usage();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (fram_init(fram_path) < 0 || pty_open(link) < 0)
+        return 1;
+
+    uint16_t cause = SYSRSTIV_BOR;
+    for (;;) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            sim_init(cause);
+            fw_main();
+            _exit(0);
+        }
+
+        int status;
+        while (waitpid(pid, &status, 0) < 0)
+            ;
+        if (WIFEXITED(status) && WEXITSTATUS(status) > EXIT_RESET) {
+            cause = WEXITSTATUS(status) - EXIT_RESET;
+            fprintf(stderr, "%.6f s: %s\n", (double)emu_clock() / SIM_NS, reset_name(cause));
+            continue;
+        }
+
+        if (WIFSIGNALED(status))
+            fprintf(stderr, "Firmware terminated by signal %d\n", WTERMSIG(status));
+        else
+            fprintf(stderr, "Firmware returned from main\n");
+        break;
+    }
+
+    if (link)
+        unlink(link);
+    return 1;
+}
@@ -0,0 +1,66 @@
+#ifndef EMU_H
+#define EMU_H
+
+#include <stdint.h>
+
+/*
+ * Firmware-in-the-loop emulator of the v4 sun sensor.
+ *
+ * emu.c    Reset supervisor, pseudo-terminal and FRAM write protection
+ * sim.c    Simulated peripherals: timers, UART, ADC, watchdog
+ * spot.c   Scripted light spot feeding the ADC
+ */
+
+// Simulated time [ns since the emulator started], runs with the host clock
+typedef uint64_t sim_time_t;
+
+#define SIM_NS      1000000000ULL
+#define SIM_NEVER   UINT64_MAX
+
+/*
+ * emu.c
+ */
+
+// Master side of the bus pseudo-terminal
+extern int emu_pty;
+
+sim_time_t emu_clock(void);
+
+/*
+ * Reset the device: the firmware restarts with fresh RAM and the FRAM
+ * kept, SYSRSTIV reads the cause. Does not return.
+ */
+void emu_reset(uint16_t cause);
+
+/*
+ * Write protect the FRAM regions protected by SYSCFG0 again.
+ */
+void fram_sync(void);
+
+/*
+ * sim.c
+ */
+
+/*
+ * Power-on state of the peripherals, the reset vector reads cause.
+ */
+void sim_init(uint16_t cause);
+
+/*
+ * spot.c
+ */
+
+// Standard deviation of the conversion noise [LSB]
+extern double spot_noise;
+
+/*
+ * Load the light spot script, returns 0 on success.
+ */
+int spot_load(const char* path);
+
+/*
+ * Conversion result of an ADC input channel at time t.
+ */
+uint16_t spot_adc(sim_time_t t, uint16_t channel);
+
+#endif /* EMU_H */
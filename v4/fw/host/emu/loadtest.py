@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+    Load test of the sensor bus, with the emulator or a sensor on a serial port.
+
+    Sends requests back to back or at a fixed rate and measures the time
+    from the last byte written to the last byte of the response. Corrupted
+    (one bit flipped) and truncated frames can be mixed in: the sensor must
+    not respond to them, and must answer the next request, after its RX
+    timeout for a truncated frame.
+
+    Exits with an error if a valid request is not answered.
+
+    --warm-restart instead checks the warm restart after the idle reset of a
+    build with WARM_RESTART and TIME_SYNC: the local time is set, the bus left
+    idle past the reset, and the sensor must report a short warm boot and a
+    local time that went on through the reset.
+
+    Examples:
+        ./loadtest.py /dev/pts/3 --count 1000
+        ./loadtest.py /tmp/psd --rate 100 --corrupt 0.1 --truncate 0.1
+        ./loadtest.py /dev/ttyUSB0 --baud 115200 --cmd 0x03
+        ./loadtest.py /tmp/psd --warm-restart
+"""
+
+import os
+import sys
+import time
+import tty
+import random
+import select
+import struct
+import termios
+import argparse
+
+
+SYNC = bytes([0x5A, 0xCE])
+HEADER_BYTES = 7
+CRC_BYTES = 2
+
+ADDRESS_OBC = 0x01
+ADDRESS_PSD_XP = 0xA5
+
+CMD_GET_STATUS = 0x01
+CMD_GET_BOOT = 0x0B
+CMD_SYNC_TIME = 0x0F
+
+SYSRSTIV_PMMSWPOR = 0x14
+
+TIMER_HZ = 32768
+IDLE_RESET = 20.0       # Idle time before the reset [s]
+BOOT_TICKS_MAX = 328    # Warm boot [1/32768 s], 10 ms
+TIME_ERROR_MAX = 328    # Local time error after the reset [1/32768 s], 10 ms
+
+
+def crc16(data):
+    """ CRC-16 MODBUS of bus_frame.c """
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def frame(src, dst, cmd, data=b""):
+    body = bytes([len(data) >> 8, len(data) & 0xFF, src, dst, cmd]) + data
+    crc = crc16(body)
+    return SYNC + body + bytes([crc >> 8, crc & 0xFF])
+
+
+class Port:
+    def __init__(self, path, baud):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        if baud:
+            attr = termios.tcgetattr(self.fd)
+            speed = getattr(termios, "B%d" % baud)
+            attr[4] = attr[5] = speed
+            termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        self.buf = b""
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    def flush_input(self):
+        termios.tcflush(self.fd, termios.TCIFLUSH)
+        self.buf = b""
+
+    def read_frame(self, deadline):
+        """ Next frame with a valid CRC, None at the deadline. Returns (frame, bad frames skipped) """
+        bad = 0
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf = self.buf[-1:]
+            else:
+                self.buf = self.buf[start:]
+                if len(self.buf) >= HEADER_BYTES:
+                    length = HEADER_BYTES + (self.buf[2] << 8 | self.buf[3]) + CRC_BYTES
+                    if len(self.buf) >= length:
+                        rsp, self.buf = self.buf[:length], self.buf[length:]
+                        if crc16(rsp[2:-2]) == (rsp[-2] << 8 | rsp[-1]):
+                            return rsp, bad
+                        bad += 1
+                        continue
+
+            timeout = deadline - time.monotonic()
+            if timeout <= 0 or not select.select([self.fd], [], [], timeout)[0]:
+                return None, bad
+            self.buf += os.read(self.fd, 1024)
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+def request(port, address, cmd, data=b"", timeout=0.1):
+    """ Response data of an addressed request, exits if not answered """
+    port.write(frame(ADDRESS_OBC, address, cmd, data))
+    rsp, _ = port.read_frame(time.monotonic() + timeout)
+    if rsp is None:
+        sys.exit("no response to command 0x%02X" % cmd)
+    return rsp[HEADER_BYTES:-CRC_BYTES]
+
+
+def sync_time(port, address):
+    """ Set the local time to the host clock, returns the error before """
+    master = int(time.monotonic() * TIMER_HZ) & 0xFFFFFFFF
+    data = request(port, address, CMD_SYNC_TIME, struct.pack("<I", master))
+    return struct.unpack_from("<i", data)[0]
+
+
+def warm_restart(port, args):
+    sync_time(port, args.address)
+    boots = struct.unpack("<5H", request(port, args.address, CMD_GET_BOOT))[3]
+
+    print("idle for %.0f s" % (IDLE_RESET + 5))
+    time.sleep(IDLE_RESET + 5)
+    port.flush_input()
+
+    cause, warm, boot_ticks, boots_after, _ = struct.unpack("<5H", request(port, args.address, CMD_GET_BOOT))
+    error = sync_time(port, args.address)
+    print("boot      cause 0x%02X  warm %d  boot %d ticks  boots %d -> %d" % (cause, warm, boot_ticks, boots, boots_after))
+    print("time      error %d ticks after the reset" % error)
+
+    if boots_after != boots + 1 or cause != SYSRSTIV_PMMSWPOR or not warm:
+        sys.exit("no warm restart")
+    if boot_ticks > BOOT_TICKS_MAX:
+        sys.exit("warm boot took %d ticks" % boot_ticks)
+    if abs(error) > TIME_ERROR_MAX:
+        sys.exit("local time off by %d ticks after the reset" % error)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Bus load test")
+    parser.add_argument("port", help="Serial port or emulator pty")
+    parser.add_argument("--baud", type=int, default=0, help="Baud rate of a serial port")
+    parser.add_argument("--address", type=lambda x: int(x, 0), default=ADDRESS_PSD_XP, help="Sensor address")
+    parser.add_argument("--cmd", type=lambda x: int(x, 0), default=CMD_GET_STATUS, help="Command of the requests")
+    parser.add_argument("--count", type=int, default=100, help="Number of requests")
+    parser.add_argument("--rate", type=float, default=0, help="Requests per second, 0 back to back")
+    parser.add_argument("--timeout", type=float, default=0.1, help="Response timeout [s]")
+    parser.add_argument("--corrupt", type=float, default=0, help="Share of requests with a bit flipped")
+    parser.add_argument("--truncate", type=float, default=0, help="Share of requests cut short")
+    parser.add_argument("--seed", type=int, default=1, help="Seed of the fault injection")
+    parser.add_argument("--warm-restart", action="store_true", help="Check the warm restart instead")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    port = Port(args.port, args.baud)
+    port.flush_input()
+
+    if args.warm_restart:
+        warm_restart(port, args)
+        return
+
+    request = frame(ADDRESS_OBC, args.address, args.cmd)
+    latencies = []
+    answered = lost = corrupted = truncated = spurious = bad_crc = 0
+    next_send = time.monotonic()
+
+    for _ in range(args.count):
+        if args.rate:
+            delay = next_send - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            next_send += 1.0 / args.rate
+
+        fault = rng.random()
+        if fault < args.corrupt:
+            # Any bit after the sync word, the sensor must drop the frame
+            data = bytearray(request)
+            data[rng.randrange(2, len(data))] ^= 1 << rng.randrange(8)
+            port.write(bytes(data))
+            corrupted += 1
+        elif fault < args.corrupt + args.truncate:
+            port.write(request[:rng.randrange(1, len(request))])
+            truncated += 1
+        else:
+            port.write(request)
+            sent = time.monotonic()
+            rsp, bad = port.read_frame(sent + args.timeout)
+            bad_crc += bad
+            if rsp is None:
+                lost += 1
+            else:
+                latencies.append(time.monotonic() - sent)
+                answered += 1
+            continue
+
+        # No response expected, the receiver recovers by its RX timeout
+        rsp, bad = port.read_frame(time.monotonic() + 0.005)
+        bad_crc += bad
+        if rsp is not None:
+            spurious += 1
+
+    valid = args.count - corrupted - truncated
+    print("requests  %6d  corrupted %d  truncated %d" % (args.count, corrupted, truncated))
+    print("answered  %6d / %d  lost %d  spurious %d  bad CRC %d" % (answered, valid, lost, spurious, bad_crc))
+    if latencies:
+        ms = [t * 1000 for t in latencies]
+        print("latency   min %.2f  mean %.2f  p50 %.2f  p99 %.2f  max %.2f ms" % (
+            min(ms), sum(ms) / len(ms), percentile(ms, 50), percentile(ms, 99), max(ms)))
+
+    if lost or spurious:
+        sys.exit("%d lost, %d spurious responses" % (lost, spurious))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,241 @@
+#ifndef EMU_MSP430_H
+#define EMU_MSP430_H
+
+/*
+ * Stand-in for the TI device header in the emulator build.
+ *
+ * Registers are plain variables of the simulated peripherals (sim.c), the
+ * bit values are those of msp430fr2311.h. The status register intrinsics
+ * are the interrupt points of the emulator: interrupts are delivered only
+ * when the firmware enables them or sleeps, the code in between executes
+ * in zero simulated time.
+ */
+
+#include <stdint.h>
+
+#ifdef STACK_MONITOR
+#error STACK_MONITOR needs the MSP430 memory map, not supported by the emulator
+#endif
+
+/*
+ * Status register
+ */
+#define GIE         0x0008
+#define CPUOFF      0x0010
+#define OSCOFF      0x0020
+#define SCG0        0x0040
+#define SCG1        0x0080
+#define LPM0_bits   (CPUOFF)
+#define LPM3_bits   (SCG1 + SCG0 + CPUOFF)
+
+void sim_bis_sr(uint16_t bits);
+void sim_bic_sr(uint16_t bits);
+void sim_bic_sr_on_exit(uint16_t bits);
+uint16_t sim_get_sr(void);
+
+#define __bis_SR_register(x)            sim_bis_sr(x)
+#define __bic_SR_register(x)            sim_bic_sr(x)
+#define __bic_SR_register_on_exit(x)    sim_bic_sr_on_exit(x)
+#define __enable_interrupt()            sim_bis_sr(GIE)
+#define __disable_interrupt()           sim_bic_sr(GIE)
+#define __get_interrupt_state()         sim_get_sr()
+#define __set_interrupt_state(x)        do { if ((x) & GIE) sim_bis_sr(GIE); else sim_bic_sr(GIE); } while (0)
+#define __no_operation()                do { } while (0)
+#define __delay_cycles(x)               ((void)(x))
+#define __even_in_range(x, y)           (x)
+
+// The interrupt attribute of the ISRs, they are called by the emulator
+#define interrupt(vector)               used
+#define __interrupt
+
+/*
+ * Ports and PMM
+ */
+#define BIT0 0x0001
+#define BIT1 0x0002
+#define BIT2 0x0004
+#define BIT3 0x0008
+#define BIT4 0x0010
+#define BIT5 0x0020
+#define BIT6 0x0040
+#define BIT7 0x0080
+
+extern volatile uint8_t P1DIR, P1OUT, P1SEL0, P1SEL1;
+extern volatile uint8_t P2DIR, P2OUT;
+extern volatile uint16_t PADIR, PAOUT;
+
+extern volatile uint16_t PM5CTL0;
+#define LOCKLPM5    0x0001
+
+extern volatile uint16_t PMMCTL0, PMMCTL2;
+extern volatile uint8_t PMMCTL0_H;
+#define PMMPW       0xA500
+#define PMMPW_H     0xA5
+#define PMMSWBOR    0x0004
+#define PMMSWPOR    0x0008
+#define INTREFEN    0x0001
+#define TSENSOREN   0x0008
+
+/*
+ * Reset vector, reading returns the cause of the last reset and clears it
+ */
+uint16_t sim_sysrstiv(void);
+#define SYSRSTIV            sim_sysrstiv()
+#define SYSRSTIV_NONE       0x0000
+#define SYSRSTIV_BOR        0x0002
+#define SYSRSTIV_PMMSWBOR   0x0006
+#define SYSRSTIV_PMMSWPOR   0x0014
+#define SYSRSTIV_WDTTO      0x0016
+
+/*
+ * FRAM controller, write protection (emu.c)
+ */
+extern volatile uint16_t FRCTL0, SYSCFG0;
+#define FRCTLPW     0xA500
+#define NWAITS_0    0x0000
+#define NWAITS_1    0x0010
+#define FRWPPW      0xA500
+#define PFWP        0x0001
+#define DFWP        0x0002
+
+/*
+ * Clock system
+ */
+extern volatile uint16_t CSCTL0, CSCTL1, CSCTL2, CSCTL3, CSCTL4, CSCTL5, CSCTL7;
+#define DCORSEL_5           0x000A
+#define FLLD__1             0x0000
+#define SELREF__REFOCLK     0x0010
+#define SELMS__DCOCLKDIV    0x0000
+#define SELA__REFOCLK       0x0100
+#define FLLULPUC            0x0040
+#define FLLUNLOCK           0x0300
+#define FLLUNLOCKHIS        0x0C00
+#define DIVM                0x0007
+#define DIVM__1             0x0000
+#define DIVM__8             0x0003
+#define DIVS                0x0030
+#define DIVS__1             0x0000
+#define DIVS__2             0x0010
+
+/*
+ * Watchdog
+ */
+extern volatile uint16_t WDTCTL;
+#define WDTPW           0x5A00
+#define WDTHOLD         0x0080
+#define WDTSSEL__ACLK   0x0020
+#define WDTCNTCL        0x0008
+#define WDTIS           0x0007
+#define WDTIS__512K     0x0003
+#define WDTIS__32K      0x0004
+
+/*
+ * Timer B0 and B1
+ */
+extern volatile uint16_t TB0CTL, TB0CCTL0, TB0CCR0, TB0CCTL1, TB0CCR1, TB0EX0, TB0IV;
+extern volatile uint16_t TB1CTL, TB1CCTL0, TB1CCR0;
+
+// A TBCLR written to TBxCTL takes effect before the next counter access
+volatile uint16_t* sim_tb0r(void);
+volatile uint16_t* sim_tb1r(void);
+#define TB0R                (*sim_tb0r())
+#define TB1R                (*sim_tb1r())
+#define TBSSEL__ACLK    0x0100
+#define TBSSEL__SMCLK   0x0200
+#define ID__1           0x0000
+#define ID__8           0x00C0
+#define MC              0x0030
+#define MC__UP          0x0010
+#define MC__CONTINUOUS  0x0020
+#define MC__UPDOWN      0x0030
+#define TBCLR           0x0004
+#define TBIE            0x0002
+#define TBIFG           0x0001
+#define TBIDEX__1       0x0000
+#define TBIDEX__8       0x0007
+#define CCIE            0x0010
+#define CCIFG           0x0001
+#define TBIV__TBCCR1    0x0002
+#define TBIV__TBIFG     0x000E
+
+/*
+ * eUSCI_A0 in UART mode
+ */
+extern volatile uint16_t UCA0CTLW0, UCA0BRW, UCA0MCTLW;
+extern volatile uint16_t UCA0RXBUF, UCA0TXBUF, UCA0IE, UCA0IFG, UCA0IV;
+
+// Also an interrupt point, the firmware polls it for a byte in flight
+uint16_t sim_uca0statw(void);
+#define UCA0STATW           sim_uca0statw()
+#define UCSWRST             0x0001
+#define UCSSEL__SMCLK       0x0080
+#define UCOS16              0x0001
+#define UCBRF_1             0x0010
+#define UCBRF_7             0x0070
+#define UCBRF_10            0x00A0
+#define UCBUSY              0x0001
+#define UCRXIE              0x0001
+#define UCTXIE              0x0002
+#define UCSTTIE             0x0004
+#define UCTXCPTIE           0x0008
+#define UCRXIFG             0x0001
+#define UCTXIFG             0x0002
+#define UCSTTIFG            0x0004
+#define UCTXCPTIFG          0x0008
+#define USCI_NONE           0x0000
+#define USCI_UART_UCRXIFG   0x0002
+#define USCI_UART_UCTXIFG   0x0004
+#define USCI_UART_UCSTTIFG  0x0006
+#define USCI_UART_UCTXCPTIFG 0x0008
+
+/*
+ * ADC
+ */
+extern volatile uint16_t ADCCTL0, ADCCTL1, ADCCTL2, ADCMCTL0, ADCMEM0;
+extern volatile uint16_t ADCIE, ADCIFG, ADCIV, ADCHI, ADCLO;
+#define ADCSC           0x0001
+#define ADCENC          0x0002
+#define ADCON           0x0010
+#define ADCSHT_2        0x0200
+#define ADCBUSY         0x0001
+#define ADCCONSEQ_0     0x0000
+#define ADCSSEL_1       0x0008
+#define ADCDIV_0        0x0000
+#define ADCSHP_1        0x0200
+#define ADCSHS_0        0x0000
+#define ADCRES_1        0x0010
+#define ADCDF_0         0x0000
+#define ADCSR           0x0004
+#define ADCINCH_1       0x0001
+#define ADCINCH_3       0x0003
+#define ADCINCH_4       0x0004
+#define ADCINCH_5       0x0005
+#define ADCINCH_12      0x000C
+#define ADCSREF_1       0x0010
+#define ADCSREF_2       0x0020
+#define ADCIE0          0x0001
+#define ADCINIE         0x0002
+#define ADCLOIE         0x0004
+#define ADCHIIE         0x0008
+#define ADCIFG0         0x0001
+#define ADCINIFG        0x0002
+#define ADCLOIFG        0x0004
+#define ADCHIIFG        0x0008
+#define ADCOVIFG        0x0010
+#define ADCTOVIFG       0x0020
+#define ADCIV__NONE     0x0000
+#define ADCIV__ADCOVIFG 0x0002
+#define ADCIV__ADCTOVIFG 0x0004
+#define ADCIV__ADCHIIFG 0x0006
+#define ADCIV__ADCLOIFG 0x0008
+#define ADCIV__ADCINIFG 0x000A
+#define ADCIV__ADCIFG0  0x000C
+
+/*
+ * Temperature sensor calibration of the device descriptor (TLV)
+ */
+extern const uint16_t sim_tlv_adc_cal[2];
+#define CAL_ADC_15T30   sim_tlv_adc_cal[0]
+#define CAL_ADC_15T85   sim_tlv_adc_cal[1]
+
+#endif /* EMU_MSP430_H */
@@ -0,0 +1,563 @@
+/*
+ * Simulated peripherals of the emulator.
+ *
+ * The firmware runs natively and meets the peripherals at the interrupt
+ * points of msp430.h: enabling interrupts, sleeping and polling UCBUSY.
+ * There the simulated time catches up with the host clock, the events due
+ * (timer compares, UART bytes, ADC conversions, watchdog) set their flags
+ * in time order and the pending ISRs are called in the priority order of
+ * the interrupt vectors. An ISR clearing CPUOFF on exit returns to the
+ * firmware at the time of its event.
+ *
+ * Timer B0 counts ACLK (32768 Hz), Timer B1 and the baud rate follow SMCLK
+ * as configured in CSCTL2 and CSCTL5. Bytes from the pty arrive at the
+ * configured baud rate, responses are written to the pty when their stop
+ * bit is sent.
+ */
+
+#define _GNU_SOURCE // ppoll
+
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <msp430.h>
+#include "emu.h"
+
+#define ACLK_HZ     32768
+#define VLO_HZ      10000
+#define MODOSC_HZ   4800000
+
+// UCA0TXBUF reads as this until the firmware writes a byte
+#define TXBUF_EMPTY 0xFFFF
+
+// Input is polled at most this often while the firmware is running [ns]
+#define INPUT_POLL  50000
+
+/*
+ * Registers, at their reset values
+ */
+volatile uint8_t P1DIR, P1OUT, P1SEL0, P1SEL1;
+volatile uint8_t P2DIR, P2OUT;
+volatile uint16_t PADIR, PAOUT;
+volatile uint16_t PM5CTL0 = LOCKLPM5;
+volatile uint16_t PMMCTL0, PMMCTL2;
+volatile uint8_t PMMCTL0_H;
+volatile uint16_t FRCTL0;
+volatile uint16_t CSCTL0, CSCTL1, CSCTL2 = 0x101F, CSCTL3, CSCTL4, CSCTL5, CSCTL7;
+volatile uint16_t WDTCTL = 0x0004; // Running, SMCLK, 2^15 cycles
+volatile uint16_t TB0CTL, TB0CCTL0, TB0CCR0, TB0CCTL1, TB0CCR1, TB0EX0, TB0IV;
+volatile uint16_t TB1CTL, TB1CCTL0, TB1CCR0;
+static volatile uint16_t tb0r, tb1r; // TB0R and TB1R
+volatile uint16_t UCA0CTLW0 = UCSWRST, UCA0BRW, UCA0MCTLW;
+volatile uint16_t UCA0RXBUF, UCA0TXBUF = TXBUF_EMPTY, UCA0IE, UCA0IFG = UCTXIFG, UCA0IV;
+volatile uint16_t ADCCTL0, ADCCTL1, ADCCTL2, ADCMCTL0, ADCMEM0;
+volatile uint16_t ADCIE, ADCIFG, ADCIV, ADCHI = 0x3FF, ADCLO;
+
+// Values of a typical device
+const uint16_t sim_tlv_adc_cal[2] = { 675, 802 };
+
+/*
+ * Interrupt service routines of the firmware
+ */
+void Timer_B0(void);
+void Timer_B0_overflow(void);
+void bus_rx_timeout_irq(void);
+void bus_primary_irq(void);
+void ADC_ISR(void);
+
+static sim_time_t now;
+
+static uint16_t sr;
+static uint16_t exit_clear;     // SR bits cleared on return from the ISR
+static uint8_t in_isr, stepping;
+
+static uint16_t reset_cause;
+
+static void sim_step(sim_time_t limit, uint8_t sleeping);
+
+/*
+ * Clocks
+ */
+static uint32_t smclk(void) {
+    uint32_t dcoclkdiv = ((CSCTL2 & 0x3FF) + 1) * (uint32_t)ACLK_HZ;
+    uint32_t mclk = dcoclkdiv >> (CSCTL5 & DIVM);
+    return mclk >> ((CSCTL5 & DIVS) >> 4);
+}
+
+/*
+ * Timers, only CCR0, the overflow and CCR1 of Timer B0 are used
+ */
+typedef struct {
+    volatile uint16_t *ctl, *cctl0, *ccr0, *r;
+    volatile uint16_t* ex0;     // NULL if not used
+    uint32_t hz;                // 0 while stopped
+    uint16_t count;             // TBxR at base
+    sim_time_t base;
+    uint16_t seen;              // TBxR as last updated, any other value was written
+} sim_timer_t;
+
+static sim_timer_t tb0 = { &TB0CTL, &TB0CCTL0, &TB0CCR0, &tb0r, &TB0EX0 };
+static sim_timer_t tb1 = { &TB1CTL, &TB1CCTL0, &TB1CCR0, &tb1r, NULL };
+
+static uint32_t timer_hz(const sim_timer_t* t) {
+    uint16_t ctl = *t->ctl;
+    if (!(ctl & MC))
+        return 0;
+    uint32_t hz = (ctl & TBSSEL__SMCLK) ? smclk() : ACLK_HZ;
+    hz >>= (ctl >> 6) & 3;
+    if (t->ex0)
+        hz /= (*t->ex0 & 7) + 1;
+    return hz;
+}
+
+static uint64_t timer_ticks(const sim_timer_t* t, sim_time_t at) {
+    return t->hz ? (unsigned __int128)(at - t->base) * t->hz / SIM_NS : 0;
+}
+
+// TBCLR clears the counter and itself, a later TBxR write still counts
+static void timer_clear(sim_timer_t* t) {
+    if (*t->ctl & TBCLR) {
+        *t->ctl &= ~TBCLR;
+        *t->r = t->seen = t->count = 0;
+        t->base = now;
+    }
+}
+
+volatile uint16_t* sim_tb0r(void) {
+    timer_clear(&tb0);
+    return tb0.r;
+}
+
+volatile uint16_t* sim_tb1r(void) {
+    timer_clear(&tb1);
+    return tb1.r;
+}
+
+static void timer_sync(sim_timer_t* t) {
+    timer_clear(t);
+    if (*t->r != t->seen) {
+        t->count = *t->r;
+        t->base = now;
+    }
+    uint32_t hz = timer_hz(t);
+    if (hz != t->hz) {
+        t->count += timer_ticks(t, now);
+        t->base = now;
+        t->hz = hz;
+    }
+    *t->r = t->seen = t->count + timer_ticks(t, now);
+}
+
+// Time the counter reaches target, one full period if already there
+static sim_time_t timer_when(const sim_timer_t* t, uint16_t target) {
+    if (!t->hz)
+        return SIM_NEVER;
+    uint64_t ticks = timer_ticks(t, now);
+    uint32_t delta = (uint16_t)(target - (uint16_t)(t->count + ticks));
+    if (delta == 0)
+        delta = 0x10000;
+    unsigned __int128 ns = (unsigned __int128)(ticks + delta) * SIM_NS;
+    return t->base + (sim_time_t)((ns + t->hz - 1) / t->hz);
+}
+
+/*
+ * UART
+ */
+#define RX_QUEUE 4096
+
+static struct {
+    uint8_t data;
+    sim_time_t start, end;      // Start and stop bit
+} rx_queue[RX_QUEUE];
+static unsigned rx_head, rx_tail;
+static uint8_t rx_started;
+static sim_time_t rx_line_free, input_polled;
+
+static uint8_t tx_shift, tx_buf;
+static uint8_t tx_shifting, tx_buffered;
+static sim_time_t tx_end;
+
+static sim_time_t byte_ns(void) {
+    uint32_t brf = (UCA0MCTLW >> 4) & 0xF;
+    uint32_t brs = __builtin_popcount(UCA0MCTLW >> 8);
+    // Bit length in 1/8 SMCLK cycles, UCBRSx approximated by its ones
+    uint64_t n8 = (UCA0MCTLW & UCOS16) ? (16 * UCA0BRW + brf) * 8 + brs : UCA0BRW * 8 + brs;
+    if (n8 == 0)
+        n8 = 8;
+    return 10 * n8 * SIM_NS / 8 / smclk();
+}
+
+/*
+ * Read the bytes from the pty, waiting up to the simulated time until.
+ * Every byte arrives one byte time after the previous one.
+ */
+static void uart_input(sim_time_t until) {
+    sim_time_t real = emu_clock();
+    struct timespec timeout = { 0, 0 };
+    if (until > real && until != SIM_NEVER) {
+        timeout.tv_sec = (until - real) / SIM_NS;
+        timeout.tv_nsec = (until - real) % SIM_NS;
+    }
+
+    struct pollfd pfd = { emu_pty, POLLIN, 0 };
+    if (ppoll(&pfd, 1, until == SIM_NEVER ? NULL : &timeout, NULL) <= 0 || !(pfd.revents & POLLIN))
+        return;
+
+    uint8_t buf[256];
+    unsigned free = RX_QUEUE - (rx_tail - rx_head);
+    ssize_t n = read(emu_pty, buf, free < sizeof(buf) ? free : sizeof(buf));
+    real = emu_clock();
+    input_polled = real;
+    for (ssize_t i = 0; i < n; i++) {
+        unsigned k = rx_tail++ % RX_QUEUE;
+        rx_queue[k].data = buf[i];
+        rx_queue[k].start = rx_line_free > real ? rx_line_free : real;
+        rx_queue[k].end = rx_line_free = rx_queue[k].start + byte_ns();
+    }
+}
+
+static void uart_sync(void) {
+    if (UCA0TXBUF == TXBUF_EMPTY)
+        return;
+    // Written by the firmware
+    uint8_t data = (uint8_t)UCA0TXBUF;
+    UCA0TXBUF = TXBUF_EMPTY;
+    if (UCA0CTLW0 & UCSWRST)
+        return;
+    if (!tx_shifting) {
+        tx_shift = data;
+        tx_shifting = 1;
+        tx_end = now + byte_ns();
+        UCA0IFG |= UCTXIFG;
+    }
+    else {
+        tx_buf = data;
+        tx_buffered = 1;
+        UCA0IFG &= ~UCTXIFG;
+    }
+}
+
+static void uart_tx_end(void) {
+    if (write(emu_pty, &tx_shift, 1) != 1)
+        ; // Nobody is listening, the byte is lost like on the bus
+    if (tx_buffered) {
+        tx_shift = tx_buf;
+        tx_buffered = 0;
+        tx_end = now + byte_ns();
+        UCA0IFG |= UCTXIFG;
+    }
+    else {
+        tx_shifting = 0;
+        UCA0IFG |= UCTXCPTIFG;
+    }
+}
+
+static void uart_rx_start(void) {
+    rx_started = 1;
+    UCA0IFG |= UCSTTIFG;
+}
+
+static void uart_rx_end(void) {
+    uint8_t data = rx_queue[rx_head++ % RX_QUEUE].data;
+    rx_started = 0;
+    if (UCA0CTLW0 & UCSWRST)
+        return;
+    // An unread byte is overwritten (overrun)
+    UCA0RXBUF = data;
+    UCA0IFG |= UCRXIFG;
+}
+
+uint16_t sim_uca0statw(void) {
+    if (!stepping)
+        sim_step(emu_clock(), 0);
+    return (tx_shifting || rx_started) ? UCBUSY : 0;
+}
+
+/*
+ * ADC, single conversions started with ADCSC
+ */
+static uint8_t adc_busy;
+static uint16_t adc_channel;
+static sim_time_t adc_end;
+
+static sim_time_t conversion_ns(void) {
+    static const uint16_t sample_cycles[] = { 4, 8, 16, 32, 64, 96, 128, 192 };
+    uint32_t hz;
+    switch (ADCCTL1 & 0x0018) {
+    case 0x0008: hz = ACLK_HZ; break;
+    case 0x0010: hz = smclk(); break;
+    default: hz = MODOSC_HZ; break;
+    }
+    // Sample and hold, 10-bit conversion
+    uint32_t cycles = sample_cycles[(ADCCTL0 >> 8) & 7] + 11;
+    return (sim_time_t)cycles * SIM_NS / hz;
+}
+
+static void adc_sync(void) {
+    uint16_t start = ADCON | ADCENC | ADCSC;
+    if (adc_busy || (ADCCTL0 & start) != start)
+        return;
+    ADCCTL0 &= ~ADCSC;
+    ADCCTL1 |= ADCBUSY;
+    adc_busy = 1;
+    adc_channel = ADCMCTL0 & 0x0F;
+    adc_end = now + conversion_ns();
+}
+
+static void adc_conversion_end(void) {
+    adc_busy = 0;
+    ADCCTL1 &= ~ADCBUSY;
+    if (!(ADCCTL0 & ADCON))
+        return;
+    uint16_t result = spot_adc(now, adc_channel);
+    if (ADCIFG & ADCIFG0)
+        ADCIFG |= ADCOVIFG;
+    ADCMEM0 = result;
+    ADCIFG |= ADCIFG0;
+    // Window comparator
+    if (result > ADCHI)
+        ADCIFG |= ADCHIIFG;
+    else if (result < ADCLO)
+        ADCIFG |= ADCLOIFG;
+    else
+        ADCIFG |= ADCINIFG;
+}
+
+/*
+ * Watchdog and software resets
+ */
+static sim_time_t wdt_kick;
+
+static sim_time_t wdt_when(void) {
+    static const uint8_t interval_bits[] = { 31, 27, 23, 19, 15, 13, 9, 6 };
+    if (WDTCTL & WDTHOLD)
+        return SIM_NEVER;
+    uint32_t hz;
+    switch (WDTCTL & 0x0060) {
+    case 0x0020: hz = ACLK_HZ; break;
+    case 0x0040: hz = VLO_HZ; break;
+    default: hz = smclk(); break;
+    }
+    return wdt_kick + (sim_time_t)((unsigned __int128)SIM_NS << interval_bits[WDTCTL & WDTIS]) / hz;
+}
+
+static void reset_sync(void) {
+    if (WDTCTL & WDTCNTCL) {
+        WDTCTL &= ~WDTCNTCL;
+        wdt_kick = now;
+    }
+    if (PMMCTL0 & PMMSWPOR)
+        emu_reset(SYSRSTIV_PMMSWPOR);
+    if (PMMCTL0 & PMMSWBOR)
+        emu_reset(SYSRSTIV_PMMSWBOR);
+}
+
+uint16_t sim_sysrstiv(void) {
+    uint16_t cause = reset_cause;
+    reset_cause = SYSRSTIV_NONE;
+    return cause;
+}
+
+/*
+ * Events
+ */
+enum {
+    EV_TB0_CCR0,
+    EV_TB0_OVERFLOW,
+    EV_TB0_CCR1,
+    EV_TB1_CCR0,
+    EV_RX_START,
+    EV_RX_END,
+    EV_TX_END,
+    EV_ADC,
+    EV_WDT,
+    EVENTS
+};
+
+/*
+ * Time of the next events, due gets the events at that time. Events at the
+ * same time are handled together: the compare that reached its target first
+ * would otherwise move the others a full timer period on, a systick on the
+ * timer overflow would lose the overflow.
+ */
+static sim_time_t next_event(uint16_t* due) {
+    sim_time_t t[EVENTS];
+    t[EV_TB0_CCR0] = (TB0CCTL0 & CCIE) ? timer_when(&tb0, TB0CCR0) : SIM_NEVER;
+    t[EV_TB0_OVERFLOW] = timer_when(&tb0, 0);
+    t[EV_TB0_CCR1] = (TB0CCTL1 & CCIE) ? timer_when(&tb0, TB0CCR1) : SIM_NEVER;
+    t[EV_TB1_CCR0] = (TB1CCTL0 & CCIE) ? timer_when(&tb1, TB1CCR0) : SIM_NEVER;
+    t[EV_RX_START] = (rx_head != rx_tail && !rx_started) ? rx_queue[rx_head % RX_QUEUE].start : SIM_NEVER;
+    t[EV_RX_END] = rx_started ? rx_queue[rx_head % RX_QUEUE].end : SIM_NEVER;
+    t[EV_TX_END] = tx_shifting ? tx_end : SIM_NEVER;
+    t[EV_ADC] = adc_busy ? adc_end : SIM_NEVER;
+    t[EV_WDT] = wdt_when();
+
+    sim_time_t first = SIM_NEVER;
+    uint16_t events = 0;
+    for (int i = 0; i < EVENTS; i++) {
+        if (t[i] < first) {
+            first = t[i];
+            events = 1 << i;
+        }
+        else if (t[i] == first && first != SIM_NEVER) {
+            events |= 1 << i;
+        }
+    }
+    if (due)
+        *due = events;
+    return first;
+}
+
+static void handle_event(int which) {
+    switch (which) {
+    case EV_TB0_CCR0:       TB0CCTL0 |= CCIFG; break;
+    case EV_TB0_OVERFLOW:   TB0CTL |= TBIFG; break;
+    case EV_TB0_CCR1:       TB0CCTL1 |= CCIFG; break;
+    case EV_TB1_CCR0:       TB1CCTL0 |= CCIFG; break;
+    case EV_RX_START:       uart_rx_start(); break;
+    case EV_RX_END:         uart_rx_end(); break;
+    case EV_TX_END:         uart_tx_end(); break;
+    case EV_ADC:            adc_conversion_end(); break;
+    case EV_WDT:            emu_reset(SYSRSTIV_WDTTO); break;
+    }
+}
+
+// Registers written by the firmware since the last interrupt point
+static void sync_registers(void) {
+    timer_sync(&tb0);
+    timer_sync(&tb1);
+    uart_sync();
+    adc_sync();
+    reset_sync();
+    fram_sync();
+}
+
+/*
+ * Call the highest priority pending ISR, returns 0 if none is pending.
+ */
+static int dispatch(void) {
+    void (*isr)(void);
+    uint16_t pending;
+
+    if ((TB0CCTL0 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        TB0CCTL0 &= ~CCIFG;
+        isr = Timer_B0;
+    }
+    else if ((TB0CCTL1 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        TB0CCTL1 &= ~CCIFG;
+        TB0IV = TBIV__TBCCR1;
+        isr = Timer_B0_overflow;
+    }
+    else if ((TB0CTL & (TBIE | TBIFG)) == (TBIE | TBIFG)) {
+        TB0CTL &= ~TBIFG;
+        TB0IV = TBIV__TBIFG;
+        isr = Timer_B0_overflow;
+    }
+    else if ((TB1CCTL0 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        TB1CCTL0 &= ~CCIFG;
+        isr = bus_rx_timeout_irq;
+    }
+    else if ((pending = UCA0IE & UCA0IFG & 0x000F)) {
+        // RXIFG, TXIFG, STTIFG, TXCPTIFG in priority order
+        uint16_t flag = pending & -pending;
+        UCA0IFG &= ~flag;
+        UCA0IV = 2 * __builtin_ffs(flag);
+        isr = bus_primary_irq;
+    }
+    else if ((pending = ADCIE & ADCIFG & 0x003F)) {
+        static const uint16_t flags[] = { ADCOVIFG, ADCTOVIFG, ADCHIIFG, ADCLOIFG, ADCINIFG, ADCIFG0 };
+        int i = 0;
+        while (!(pending & flags[i]))
+            i++;
+        ADCIFG &= ~flags[i];
+        ADCIV = 2 * (i + 1);
+        isr = ADC_ISR;
+    }
+    else {
+        return 0;
+    }
+
+    uint16_t saved = sr;
+    sr = 0;
+    exit_clear = 0;
+    in_isr = 1;
+    isr();
+    in_isr = 0;
+    sr = saved & ~exit_clear;
+    return 1;
+}
+
+/*
+ * Run the peripherals up to the limit, calling the ISRs while interrupts
+ * are enabled. Stops at the event whose ISR woke the CPU if sleeping.
+ */
+static void sim_step(sim_time_t limit, uint8_t sleeping) {
+    stepping = 1;
+    if (limit >= input_polled + INPUT_POLL)
+        uart_input(0);
+
+    for (;;) {
+        sync_registers();
+        if ((sr & GIE) && !in_isr && dispatch()) {
+            if (sleeping && !(sr & CPUOFF))
+                break;
+            continue;
+        }
+
+        uint16_t due;
+        sim_time_t t = next_event(&due);
+        if (t > limit) {
+            if (limit > now) {
+                now = limit;
+                sync_registers();
+            }
+            break;
+        }
+        if (t > now)
+            now = t;
+        for (int i = 0; i < EVENTS; i++) {
+            if (due & (1 << i))
+                handle_event(i);
+        }
+    }
+    stepping = 0;
+}
+
+/*
+ * Status register intrinsics
+ */
+void sim_bis_sr(uint16_t bits) {
+    sr |= bits;
+    if (in_isr || stepping || !(sr & GIE))
+        return;
+
+    for (;;) {
+        sim_step(emu_clock(), (sr & CPUOFF) != 0);
+        if (!(sr & CPUOFF))
+            break;
+        // Sleep until the next event or input
+        uart_input(next_event(NULL));
+    }
+}
+
+void sim_bic_sr(uint16_t bits) {
+    sr &= ~bits;
+}
+
+void sim_bic_sr_on_exit(uint16_t bits) {
+    if (in_isr)
+        exit_clear |= bits;
+}
+
+uint16_t sim_get_sr(void) {
+    return sr;
+}
+
+void sim_init(uint16_t cause) {
+    reset_cause = cause;
+    now = emu_clock();
+    tb0.base = tb1.base = now;
+    wdt_kick = now;
+    input_polled = now;
+}
@@ -0,0 +1,167 @@
+/*
+ * Scripted light spot on the PSD.
+ *
+ * The script lists the spot at points of time, linearly interpolated in
+ * between and held after the last point:
+ *
+ *   # time [s]  x  y  intensity  [temperature, degC]
+ *   0     0     0    800
+ *   5     500   0    800
+ *   6     500   0    0
+ *   loop
+ *
+ * x and y are in the units of CMD_GET_POSITION (-1024 to 1024 at the edges),
+ * intensity in ADC counts. A final "loop" repeats the script from the start.
+ *
+ * The light of the spot divides among the four electrode currents as on an
+ * ideal duolateral PSD, so that calculate_position() returns the scripted
+ * position. The conversion results are inverted like on the board: more
+ * light gives a lower result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <msp430.h>
+#include "emu.h"
+
+typedef struct {
+    double time, x, y, intensity, temperature;
+} spot_point_t;
+
+#define SPOT_POINTS_MAX 1024
+
+static spot_point_t points[SPOT_POINTS_MAX] = {
+    { 0, 0, 0, 800, 25 } // Default: centered, no script
+};
+static int point_count = 1;
+static double period; // 0 if not looping
+
+double spot_noise = 0.5;
+
+/*
+ * ADC input channels of the PSD electrodes, as in adc.c
+ */
+#ifdef V4X
+#define CH_VX1  ADCINCH_1
+#define CH_VX2  ADCINCH_3
+#define CH_VY1  ADCINCH_4
+#define CH_VY2  ADCINCH_5
+#else
+#define CH_VX1  ADCINCH_5
+#define CH_VX2  ADCINCH_4
+#define CH_VY1  ADCINCH_3
+#define CH_VY2  ADCINCH_1
+#endif
+
+int spot_load(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    int n = 0, lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char word[16];
+        if (sscanf(line, "%15s", word) != 1)
+            continue;
+        if (strcmp(word, "loop") == 0) {
+            period = n > 0 ? points[n - 1].time : 0;
+            break;
+        }
+
+        spot_point_t p = { .temperature = 25 };
+        if (sscanf(line, "%lf %lf %lf %lf %lf", &p.time, &p.x, &p.y, &p.intensity, &p.temperature) < 4
+            || (n > 0 && p.time < points[n - 1].time) || n == SPOT_POINTS_MAX) {
+            fprintf(stderr, "%s:%d: invalid spot point\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        points[n++] = p;
+    }
+    fclose(f);
+
+    if (n == 0) {
+        fprintf(stderr, "%s: no spot points\n", path);
+        return -1;
+    }
+    point_count = n;
+    return 0;
+}
+
+static spot_point_t spot_at(double t) {
+    if (period > 0)
+        t = fmod(t, period);
+    if (t <= points[0].time)
+        return points[0];
+
+    int i = 1;
+    while (i < point_count && points[i].time < t)
+        i++;
+    if (i == point_count)
+        return points[point_count - 1];
+
+    const spot_point_t* a = &points[i - 1];
+    const spot_point_t* b = &points[i];
+    double k = (t - a->time) / (b->time - a->time);
+    spot_point_t p = {
+        t,
+        a->x + k * (b->x - a->x),
+        a->y + k * (b->y - a->y),
+        a->intensity + k * (b->intensity - a->intensity),
+        a->temperature + k * (b->temperature - a->temperature),
+    };
+    return p;
+}
+
+// Gaussian noise, deterministic from run to run
+static double noise(void) {
+    static uint32_t state = 0x12345678;
+    double u[2];
+    for (int i = 0; i < 2; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        u[i] = (state + 1.0) / 4294967297.0;
+    }
+    return sqrt(-2 * log(u[0])) * cos(2 * M_PI * u[1]);
+}
+
+uint16_t spot_adc(sim_time_t t, uint16_t channel) {
+    spot_point_t p = spot_at((double)t / SIM_NS);
+
+    if (channel == ADCINCH_12) {
+        // Temperature sensor against the calibration of the TLV
+        double cal30 = sim_tlv_adc_cal[0], cal85 = sim_tlv_adc_cal[1];
+        double raw = cal30 + (p.temperature - 30) * (cal85 - cal30) / 55 + spot_noise * noise();
+        return raw < 0 ? 0 : raw > 1023 ? 1023 : (uint16_t)lround(raw);
+    }
+
+    // Share of the light of each electrode, the four add up to 4
+    double u = p.x / 2048, v = p.y / 2048;
+    double share;
+    switch (channel) {
+    case CH_VX1: share = (1 - u) * (1 - v); break;
+    case CH_VX2: share = (1 + u) * (1 + v); break;
+    case CH_VY1: share = (1 + u) * (1 - v); break;
+    case CH_VY2: share = (1 - u) * (1 + v); break;
+    default: share = 0; break;
+    }
+
+    double light = p.intensity * share + spot_noise * noise();
+    long level = lround(light);
+    if (level < 0)
+        level = 0;
+    if (level > 1023)
+        level = 1023;
+    return (uint16_t)(1023 - level);
+}
@@ -0,0 +1,29 @@
+#ifndef HOST_MSP430_H
+#define HOST_MSP430_H
+
+/*
+ * Stand-in for the TI device header in host builds.
+ * Intrinsics do nothing. Registers are plain variables defined in the host
+ * program when a module under test needs them.
+ */
+
+#include <stdint.h>
+
+#define __no_operation()            do { } while (0)
+#define __enable_interrupt()        do { } while (0)
+#define __disable_interrupt()       do { } while (0)
+#define __get_interrupt_state()     0
+#define __set_interrupt_state(x)    ((void)(x))
+#define __delay_cycles(x)           ((void)(x))
+
+#define __interrupt
+#define __bis_SR_register(x)        ((void)(x))
+#define __bic_SR_register(x)        ((void)(x))
+
+// FRAM write protection
+extern volatile uint16_t SYSCFG0;
+#define FRWPPW  0xA500
+#define DFWP    0x0002
+#define PFWP    0x0001
+
+#endif /* HOST_MSP430_H */
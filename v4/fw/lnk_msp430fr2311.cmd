@@ -57,6 +57,7 @@
 MEMORY
 {
     BSL0                    : origin = 0x1000, length = 0x800
+    INFO                    : origin = 0x1800, length = 0x200
     RAM                     : origin = 0x2000, length = 0x400
     FRAM_VARS               : origin = 0xF100, length = 0x0010
     FRAM                    : origin = 0xF110, length = 0x0E70
@@ -173,6 +174,7 @@ SECTIONS
     .stack      : {} > RAM (HIGH)           /* Software system stack             */
 
     .fram_vars : {} > FRAM_VARS type=NOINIT
+    .info_vars : {} > INFO
 
     /* MSP430 interrupt vectors */
 
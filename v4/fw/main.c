@@ -3,8 +3,32 @@
 #include "main.h"
 #include "adc.h"
 #include "telecommands.h"
-
-static volatile int interrupt_pending = 0;
+#include "spin.h"
+#include "boot.h"
+#include "sched.h"
+#include "clock.h"
+#include "profile.h"
+#include "ramfunc.h"
+#include "energy.h"
+#include "stack.h"
+
+/* Events of the tasks */
+#define EV_BUS          0x0001 // Frame received
+#define EV_SPIN         0x0002 // Next spin mode sample
+#define EV_SUN_MONITOR  0x0004
+#define EV_SLEEP        0x0008 // Idle timeouts
+#define EV_IDLE_RESET   0x0010
+
+/* Scheduler timers */
+#define TIMER_SLEEP         0
+#define TIMER_IDLE_RESET    1
+#define TIMER_SUN_MONITOR   2
+
+#ifdef SPIN_MODE
+#define SPIN_ACTIVE() (spin_config.enabled)
+#else
+#define SPIN_ACTIVE() 0
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Platform bus code
@@ -20,6 +44,13 @@ typedef struct {
 	size_t tx_idx, tx_len;
 
 	int slave_rxed;
+
+#ifdef PROFILER
+	uint16_t tx_start;
+#endif
+
+	// Bytes received since a start edge woke the CPU from LPM3
+	uint8_t wake_bytes;
 } BusDriver;
 
 #define BUS_ID_PRIMARY 0
@@ -42,7 +73,9 @@ void bus_slave_send(BusHandle* self, BusFrame* rsp) {
 	UCA0IE = 0;
 
 	// Prepare for transmitting
+	PROFILE_START(PROF_TX_PREPARE);
 	const BusFrame* tx_frame = bus_prepare_tx_frame(rsp);
+	PROFILE_STOP(PROF_TX_PREPARE);
 	driver->tx_buf = tx_frame->buf;
 	driver->tx_len = tx_frame->len + BUS_OVERHEAD;
 	driver->tx_idx = 0;
@@ -51,6 +84,9 @@ void bus_slave_send(BusHandle* self, BusFrame* rsp) {
 	// NOTE: TX empty buffer flag needs to be set manually
 	if (driver->active_bus == BUS_ID_PRIMARY) {
 		RS485_PRI_DIR_TX();
+#ifdef PROFILER
+		driver->tx_start = PROFILE_NOW();
+#endif
 		UCA0IFG = UCTXIFG;
 		UCA0IE = UCTXIE;
 	}
@@ -58,6 +94,14 @@ void bus_slave_send(BusHandle* self, BusFrame* rsp) {
 
 static BusHandle bus_adcs;
 
+// RX timeout after the last byte [TB1 ticks], set by the clock profile
+uint16_t bus_rx_timeout = 400; // 0.4 msec
+
+#ifdef TIME_SYNC
+// Timer B0 at the sync low byte of the last frame
+uint16_t bus_sync_ticks;
+#endif
+
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector = TIMER1_B0_VECTOR
 __interrupt void bus_rx_timeout_irq()
@@ -67,7 +111,7 @@ void __attribute__ ((interrupt(TIMER1_B0_VECTOR))) bus_rx_timeout_irq()
 #error Compiler not supported!
 #endif
 {
-	TB1CTL &= ~MC__UPDOWN; // Put into stop mode
+	TB1CCTL0 = 0; // Disable timeout
 
 	bus_adcs.receive_timeouts++;
 
@@ -81,9 +125,9 @@ void __attribute__ ((interrupt(TIMER1_B0_VECTOR))) bus_rx_timeout_irq()
 
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector=USCI_A0_VECTOR
-__interrupt void bus_primary_irq()
+RAMFUNC __interrupt void bus_primary_irq()
 #elif defined(__GNUC__)
-void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
+RAMFUNC void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
 #else
 #error Compiler not supported!
 #endif
@@ -93,15 +137,37 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
     switch(__even_in_range(UCA0IV, USCI_UART_UCTXCPTIFG)) {
         case USCI_NONE: break;
         case USCI_UART_UCRXIFG: { // Receive buffer full
+        	PROFILE_START(PROF_RX_ISR);
         	driver->active_bus = BUS_ID_PRIMARY;
 
         	// Enable receiver timeout timer
-        	TB1CTL |= MC__UP | TBCLR;
+        	TB1CCR0 = TB1R + bus_rx_timeout;
 			TB1CCTL0 = CCIE;
 
-        	if (bus_handle_rx_byte(&bus_adcs, UCA0RXBUF)) {
-        		// Disable timer
-				TB1CTL &= ~MC__UPDOWN;
+			uint8_t data = UCA0RXBUF;
+
+#ifdef TICKLESS_IDLE
+			// The DCO may start too late for the first byte after LPM3.
+			// The sync high byte is not part of the CRC, so a frame
+			// starting at the sync low byte is completed here.
+			if (driver->wake_bytes) {
+				driver->wake_bytes--;
+				if (data == BUS_SYNC_LOW && bus_adcs.rx_index == 0)
+					bus_handle_rx_byte(&bus_adcs, BUS_SYNC_HIGH);
+			}
+#endif
+
+#ifdef TIME_SYNC
+			// Latch the end of the sync word for CMD_SYNC_TIME
+			if (bus_adcs.rx_index == 1) {
+				do {
+					bus_sync_ticks = TB0R;
+				} while (bus_sync_ticks != TB0R);
+			}
+#endif
+
+        	if (bus_handle_rx_byte(&bus_adcs, data)) {
+        		// Disable timeout
 				TB1CCTL0 = 0;
 
         		// After receiving successfully a frame appointed to our device,
@@ -111,9 +177,10 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
 
 				// Wake up the main thread.
 				driver->slave_rxed = 1;
-				interrupt_pending = 1;
-				__bic_SR_register_on_exit(LPM0_bits);
+				sched_post(EV_BUS);
+				__bic_SR_register_on_exit(LPM3_bits);
         	}
+        	PROFILE_STOP(PROF_RX_ISR);
         } break;
         case USCI_UART_UCTXIFG: { // Transmit buffer empty
         	if (driver->tx_idx < driver->tx_len) {
@@ -125,14 +192,28 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
         } break;
         case USCI_UART_UCSTTIFG: { // Start bit received
         	UCA0IFG &= ~UCSTTIFG;
+#ifdef TICKLESS_IDLE
+        	// Woken from LPM3 by the start edge. Stay in LPM0 with the DCO
+        	// running until the frame is complete or has timed out.
+        	UCA0IE &= ~UCSTTIE;
+        	TB1CTL |= MC__CONTINUOUS; // Stopped in LPM3, needed for the RX timeout
+        	ENERGY_MODE(POWER_LPM0);
+        	driver->wake_bytes = 2;
+        	__bic_SR_register_on_exit(SCG1 | SCG0);
+#endif
         } break;
         case USCI_UART_UCTXCPTIFG: { // Transmit complete
         	UCA0IE = 0;
         	UCA0IFG &= ~UCTXCPTIE;
+        	PROFILE_RECORD(PROF_TX, PROFILE_NOW() - driver->tx_start);
 
         	// Go to receiver mode on bus
         	RS485_PRI_DIR_RX();
 			UCA0IE = UCRXIE;
+#ifdef TICKLESS_IDLE
+			// The bus is idle again, LPM3 from here on
+			__bic_SR_register_on_exit(LPM3_bits);
+#endif
         } break;
         default: break;
     }
@@ -145,9 +226,13 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) bus_primary_irq()
 
 volatile uint16_t sys_ticks = 0;
 
-unsigned int idle_counter = ~0;
+// Idle timeouts in systicks
+#define SLEEP_TIMEOUT       256  // 4 s
+#define IDLE_RESET_TIMEOUT  1280 // 20 s
+
 void reset_idle_counter(){
-    idle_counter = 0;
+    sched_timer_start(TIMER_SLEEP, SLEEP_TIMEOUT + 1, EV_SLEEP);
+    sched_timer_start(TIMER_IDLE_RESET, IDLE_RESET_TIMEOUT, EV_IDLE_RESET);
 }
 
 // Sleep mode indicator flag. Sleep Mode - 0, Enabled - 1
@@ -162,12 +247,14 @@ void sleepmode() {
 	ADCCTL0 &= ~ADCON; // Disable ADC
 	PMMCTL0_H = 0; // Lock PMM
 
+	ENERGY_AFE(0);
 	sleep_mode = 1;
 }
 
 void wakeup() {
 
 	OPAMP_ON();
+	ENERGY_AFE(1);
 
 	PMMCTL0_H = PMMPW_H; // Unlock PMM
 	PMMCTL2 |= INTREFEN; // Enable internal voltage reference
@@ -175,7 +262,11 @@ void wakeup() {
 	ADCCTL0 |= ADCON; // Enable ADC
 	PMMCTL0_H = 0; // Lock PMM
 
+#ifdef CLOCK_SCALING
+	__delay_cycles(800);  // Delay for stuff to settle, 50 us at 16 MHz
+#else
 	__delay_cycles(400);  // Delay for stuff to settle
+#endif
 
 	sleep_mode = 0;
 }
@@ -189,16 +280,19 @@ void wakeup() {
  * WDTSSEL__ACLK = 32kHz
  * Reset Time [sec] = (2^X) / CLK_SOURCE
  * See WDTIS for values of X
- * WDTIS__512K = 16s
+ * WDTIS__512K = 16s, the tickless idle sleeps up to one timer period (2 s) between the kicks
+ * WDTIS__32K = 1s
  */
-#ifdef USE_WDT
+#if defined(USE_WDT) && defined(TICKLESS_IDLE)
+#define RESET_WDT() (WDTCTL = WDTPW + WDTSSEL__ACLK + WDTIS__512K + WDTCNTCL)
+#elif defined(USE_WDT)
 #define RESET_WDT() (WDTCTL = WDTPW + WDTSSEL__ACLK + WDTIS__32K + WDTCNTCL)
 #else
 #define RESET_WDT() (WDTCTL = WDTPW + WDTHOLD) // Disabled!
 #endif
 
 
-void configure_clocks() {
+void configure_clocks(uint16_t dco_trim) {
     // Configure one FRAM waitstate as required by the device datasheet for MCLK
     // operation beyond 8MHz _before_ configuring the clock system.
     FRCTL0 = FRCTLPW;
@@ -221,9 +315,16 @@ void configure_clocks() {
     // Configure DCO & FLL
     __bis_SR_register(SCG0);    // Disable FLL
     CSCTL3 |= SELREF__REFOCLK;  // Select reference clock source for FLL
-    CSCTL0 = 0;                // Clear the CSCTL0 register.
+    CSCTL0 = dco_trim;         // Clear the CSCTL0 register, or preload the DCO tap the FLL
+                               // had locked to before a warm restart so it locks at once.
     CSCTL1 |= DCORSEL_5;        // Set DCO range to 16MHz
+#ifdef CLOCK_SCALING
+    CSCTL2 = FLLD__1 | 487;     // DCOCLKDIV = (487 + 1) * 32768 Hz = 16MHz, divided down by the clock profile (clock.c)
+#else
     CSCTL2 |= FLLD__1 | 243;    // Set target frequency (16MHz) for FLL
+                                // NOTE: CSCTL2 resets to FLLD__2 | 31, so this sets FLLN = 255 and
+                                // DCOCLKDIV = 256 * 32768 Hz = 8.39MHz. The UART divisors are tuned to it.
+#endif
                                 // DCOCLK = 2^FLLD * (FLLN +1) * (FLLRefclk/n)
                                 // DCOCLKDIV = (FLLN +1) * (FLLRefclk/n)
                                 // n = FLLREFDIV (fixed to 1 for 32kHz)
@@ -290,27 +391,30 @@ void init_gpio(void){
 }
 
 
-void init_heartbeat_timer() {
+void init_heartbeat_timer(uint32_t start) {
 	/*
 	 * Configure TimerB0
 	 *
-	 * SMCLK = DCOCLKDIV
-	 * Timer frequency(Hz) = SMCLK / (TB0CCR0 * 8 * 8)
-	 * TB0CCR0 = SMCLK / (timer_frequency(Hz)*8*8)
-	 * add 50 for every 1000, was measured to be more spot on at 16ms at room temp
+	 * ACLK = REFO = 32768 Hz, continuous mode
+	 * The overflow interrupt extends TB0R to the 32-bit get_timer_ticks().
+	 * CCR0 wakes the main loop every systick (2^TICK_SHIFT ticks = 15.6 ms),
+	 * or with TICKLESS_IDLE only at the next deadline.
+	 * The count starts from start, the timer ticks before a warm restart.
 	 */
 
-	TB0CTL = MC__UP + TBSSEL__SMCLK + ID__8;    // UP mode, SMCLK, divide by 8
-	TB0CCR0 = 2100;                             // up to this count
-	TB0EX0 = TBIDEX__8;                         // Divide by 8
-	TB0CCTL0 = CCIE;                            // TACCR0 interrupt enabled
-	TB0CTL |= TBCLR;
-	TB0R = 0;
+	TB0CTL = TBSSEL__ACLK + ID__1 + TBCLR;      // ACLK, no divider
+	TB0EX0 = TBIDEX__1;
+	TB0R = (uint16_t)start;
+	timer_overflows = start >> 16;
+	sys_ticks = start >> TICK_SHIFT;
+	TB0CCR0 = (sys_ticks + 1) << TICK_SHIFT;    // Next systick
+	TB0CCTL0 = CCIE;                            // TBCCR0 interrupt enabled
+	TB0CTL |= MC__CONTINUOUS + TBIE;            // Continuous mode, overflow interrupt enabled
 }
 
 
 /*
- * Timer B0 interrupt (triggering every 16ms)
+ * Timer B0 CCR0 interrupt (triggering every systick, or at the tickless deadline)
  */
  #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector = TIMER0_B0_VECTOR
@@ -321,14 +425,145 @@ void __attribute__ ((interrupt(TIMER0_B0_VECTOR))) Timer_B0()
 #error Compiler not supported!
 #endif
 {
-    sys_ticks++; // sys_tick every 16 ms
+#ifndef TICKLESS_IDLE
+    TB0CCR0 += HEARTBEAT_TICKS;
+    sys_ticks++; // sys_tick every 15.6 ms
+#endif
 	// Wake up the main loop
     LED_TOGGLE();
     RESET_WDT();
-	__bic_SR_register_on_exit(LPM0_bits);
+	__bic_SR_register_on_exit(LPM3_bits);
 }
 
 
+#ifdef TICKLESS_IDLE
+// Wake the main loop at the next overflow, the deadline is further than one timer period
+static volatile uint8_t wake_on_overflow = 0;
+#endif
+
+/*
+ * Timer B0 overflow interrupt (triggering every 2 s) and CCR1 interrupt
+ */
+ #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = TIMER0_B1_VECTOR
+__interrupt void Timer_B0_overflow()
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(TIMER0_B1_VECTOR))) Timer_B0_overflow()
+#else
+#error Compiler not supported!
+#endif
+{
+    switch(__even_in_range(TB0IV, TBIV__TBIFG)) {
+        case TBIV__TBCCR1:
+            // ADC conversion timeout (adc.c)
+            TB0CCTL1 = 0;
+            adc_timed_out = 1;
+            __bic_SR_register_on_exit(LPM3_bits);
+            break;
+        case TBIV__TBIFG:
+            timer_overflows++;
+#ifdef TICKLESS_IDLE
+            if (wake_on_overflow) {
+                wake_on_overflow = 0;
+                __bic_SR_register_on_exit(LPM3_bits);
+            }
+#endif
+            break;
+        default: break;
+    }
+}
+
+
+// No frame being received or transmitted
+static uint8_t bus_idle() {
+	return UCA0IE == UCRXIE && !(UCA0STATW & UCBUSY) && !(TB1CCTL0 & CCIE);
+}
+
+#ifdef CLOCK_SCALING
+/*
+ * Switch the clock profile between frames, with the start edge interrupt off
+ * (bus idle or receiver disabled) so that its flag can be cleared here:
+ * clock_set_profile() leaves the UART alone if a byte starts from here on.
+ */
+static void clock_switch(uint8_t profile) {
+	UCA0IFG &= ~UCSTTIFG;
+	clock_set_profile(profile);
+}
+#endif
+
+/*
+ * Scheduler idle hook: sleep until the deadline (systick) or bus activity.
+ *
+ * The heartbeat wakes the CPU every systick, so LPM0 is the deepest safe
+ * mode without TICKLESS_IDLE: LPM3 would lose the first byte of a frame.
+ *
+ * With TICKLESS_IDLE, LPM3 stops the DCO, so it is used only while the bus
+ * is idle. The start edge of the next frame requests SMCLK for the UART and
+ * wakes the CPU to LPM0 for the rest of the frame. While receiving or
+ * transmitting, LPM0.
+ */
+void sched_idle(uint16_t deadline, uint8_t timed) {
+	RESET_WDT();
+
+	uint8_t idle = bus_idle();
+	uint16_t lpm = LPM0_bits;
+
+#ifdef TICKLESS_IDLE
+	uint16_t ahead = deadline - (uint16_t)(get_timer_ticks() >> TICK_SHIFT);
+
+	// Already due
+	if (timed && (ahead == 0 || ahead >= 0x8000)) {
+		__enable_interrupt();
+		return;
+	}
+
+	if (timed && ahead < (1 << (16 - TICK_SHIFT))) {
+		// Within one timer period
+		TB0CCR0 = deadline << TICK_SHIFT;
+		TB0CCTL0 = CCIE;
+		wake_on_overflow = 0;
+	}
+	else {
+		TB0CCTL0 = 0;
+		wake_on_overflow = 1;
+	}
+
+	if (idle)
+		lpm = LPM3_bits;
+#else
+	(void)deadline;
+	(void)timed;
+	(void)idle;
+#endif
+
+#ifdef CLOCK_SCALING
+	if (idle)
+		clock_switch(CLOCK_IDLE);
+	clock_sleep();
+#endif
+
+	if (lpm == LPM3_bits) {
+		// A running Timer B1 would request SMCLK and keep the DCO on
+		TB1CTL &= ~MC__CONTINUOUS;
+		UCA0IFG &= ~UCSTTIFG;
+		UCA0IE |= UCSTTIE;
+		ENERGY_MODE(POWER_LPM3);
+		__bis_SR_register(LPM3_bits | GIE);
+		TB1CTL |= MC__CONTINUOUS;
+		// Woken by a timer, otherwise the bus would not count as idle next time
+		UCA0IE &= ~UCSTTIE;
+	}
+	else {
+		ENERGY_MODE(POWER_LPM0);
+		__bis_SR_register(LPM0_bits | GIE);
+	}
+	ENERGY_MODE(POWER_ACTIVE);
+
+#ifdef CLOCK_SCALING
+	clock_wake();
+#endif
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Platform initialization and main loop
@@ -339,6 +574,25 @@ static void platform_init() {
 
 	WDTCTL = WDTPW | WDTHOLD;
 
+#ifdef STACK_MONITOR
+	stack_paint();
+#endif
+
+#ifdef WARM_RESTART
+	int warm = warm_restore(&bus_adcs);
+	uint32_t start = warm ? warm_state.ticks : 0;
+	uint16_t dco_trim = warm ? warm_state.dco_trim : 0;
+#else
+	uint32_t start = 0;
+	uint16_t dco_trim = 0;
+#endif
+
+	// ACLK runs from REFO out of reset, the timer also measures the boot time
+	init_heartbeat_timer(start);
+#ifdef ENERGY_STATS
+	energy_init();
+#endif
+
 	// Pin configuration
 	{
 		/*
@@ -355,11 +609,11 @@ static void platform_init() {
 	}
 
 	// UART reception timeout timer configuration
+	// Free running, the timeout is a CCR0 offset. Also the profiler clock.
 	{
-		TB1CTL = TBSSEL__SMCLK | ID__8 | MC__UP;
+		TB1CTL = TBSSEL__SMCLK | ID__8 | TBCLR;
 		TB1CCTL0 = 0;
-		TB1R = 0;
-		TB1CCR0 = 399; // 0.2 msec
+		TB1CTL |= MC__CONTINUOUS;
 	}
 
 	// UART configuration
@@ -378,6 +632,7 @@ static void platform_init() {
         //UCA0MCTLW |= UCBRF_5 | 0x5500;          // Modulation UCBRSx=0x55, UCBRFx=5
 
         // Baud rate of OBC is 3% (111607) slower AND MESSES UP EVERYTHING
+		// CLOCK_SCALING reprograms the baud rate for each clock profile
 		UCA0BRW = 4;                            // Set the baud rate to 115200 (8MHz)
 		UCA0MCTLW |= UCBRF_10 | 0xB700;          // Modulation UCBRSx=0xB7, UCBRFx=10
 
@@ -394,7 +649,10 @@ static void platform_init() {
 	/*
 	 * 1) Initialization of clocks
 	 */
-	configure_clocks();
+	configure_clocks(dco_trim);
+#ifdef CLOCK_SCALING
+	clock_set_profile(CLOCK_IDLE);
+#endif
 
 
 	// Disable the GPIO power-on default high-impedance mode to activate
@@ -406,7 +664,6 @@ static void platform_init() {
 	 */
 
 	init_adc();
-	init_heartbeat_timer();
 
 	sleepmode();
 
@@ -418,54 +675,186 @@ static void platform_init() {
 	__no_operation(); // First chance for the interrupt to fire!
 
 	RESET_WDT();
+	reset_idle_counter();
+
+#ifdef WARM_RESTART
+	boot_info.boot_ticks = get_timer_ticks() - start;
+#endif
 
 	LED_ON();
 }
 
-static void platform_loop() {
-	BusDriver bus_driver = { 0 };
-	bus_adcs.driver = &bus_driver;
+/*
+ * Tasks
+ *
+ * Worst-case run times [ms], bounded from the code paths:
+ * - wakeup() settles the front end for 800 cycles, 0.4 ms at the 2 MHz of
+ *   the idle clock profile, 1 ms with the register writes around it.
+ * - The ADC runs on ACLK, so conversions take the same time in every clock
+ *   profile: CONVERSION_DURATION each, SAMPLE_DURATION for a sample of the
+ *   four channels. Every TEMPERATURE_INTERVAL samples a temperature
+ *   conversion is chained. A stalled ADC is given up ADC_TIMEOUT_MARGIN
+ *   after that by the Timer B0 CCR1 interrupt.
+ * - The calculations of a sample take < 2000 cycles (calculate_position(),
+ *   calculate_angles() and the unit vector with MPY32, see the fixmath.h
+ *   table), 1 ms at 2 MHz, counted twice in the bus task for the response.
+ * The bus task samples at most SAMPLES_MAX times, the spin task once and
+ * calculates the position at a sun exit, the sun monitor makes one
+ * window conversion. The idle task only saves the warm state and resets.
+ * CMD_GET_CYCLES of PROFILER builds is a diagnostic and not bounded.
+ */
+#define WAKEUP_WCET         1
+#define CALC_WCET           1
+#define SAMPLING_WCET(n)    ((n) * SAMPLE_DURATION + CONVERSION_DURATION + ADC_TIMEOUT_MARGIN)
 
-	for (;;) {
+#define BUS_TASK_WCET       (WAKEUP_WCET + SAMPLING_WCET(SAMPLES_MAX) + 2 * CALC_WCET)
+#define SPIN_TASK_WCET      (WAKEUP_WCET + SAMPLING_WCET(1) + CALC_WCET)
+#define MONITOR_TASK_WCET   (WAKEUP_WCET + CONVERSION_DURATION + ADC_TIMEOUT_MARGIN)
+#define IDLE_TASK_WCET      1
 
-		RESET_WDT();
+/*
+ * Deadlines [ms] from the event to the end of the run. A response must be
+ * complete within the 100 ms response timeout of the OBC (loadtest.py).
+ * Spin samples and sun monitor conversions are due at least once per sun
+ * monitor period (SUN_MONITOR_PERIOD systicks of 1000/64 ms), the idle
+ * task before the 1 s watchdog.
+ */
+#define BUS_TASK_DEADLINE       100
+#define SPIN_TASK_DEADLINE      (SUN_MONITOR_PERIOD * 1000 / 64)
+#define MONITOR_TASK_DEADLINE   (SUN_MONITOR_PERIOD * 1000 / 64)
+#define IDLE_TASK_DEADLINE      1000
+
+// Look for the sun in the background while in eclipse
+static void arm_sun_monitor() {
+	if (!sun_present && !sched_timer_active(TIMER_SUN_MONITOR))
+		sched_timer_start(TIMER_SUN_MONITOR, SUN_MONITOR_PERIOD, EV_SUN_MONITOR);
+}
 
-		// Make sure that all interrupts are serviced before going to sleep
-		__disable_interrupt();
-		if (!interrupt_pending) {
-			__bis_SR_register(LPM0_bits | GIE);
-		}
-		interrupt_pending = 0;
-		__enable_interrupt();
+static void bus_task(uint16_t events) {
+	BusFrame* cmd = bus_slave_receive(&bus_adcs);
+	if (cmd != NULL) {
+#ifdef CLOCK_SCALING
+		// The frame is complete and the receiver disabled until the response
+		if (clock_config.burst)
+			clock_switch(CLOCK_BURST);
+		clock_stats.requests[clock_profile]++;
+#endif
+#ifdef ENERGY_STATS
+		uint8_t code = cmd->cmd;
+		energy_command_start();
+#endif
+		BusFrame* rsp = bus_get_tx_frame(&bus_adcs);
+		PROFILE_START(PROF_COMMAND);
+		handle_command(cmd, rsp);
+		PROFILE_STOP(PROF_COMMAND);
+#ifdef BUS_BROADCAST
+		// Every slave handles a broadcast, none may respond
+		if (cmd->dst == BUS_ADDRESS_BROADCAST)
+			UCA0IE = UCRXIE;
+		else
+#endif
+		bus_slave_send(&bus_adcs, rsp);
+#ifdef ENERGY_STATS
+		energy_command_end(code);
+#endif
+	}
 
-		// Update slave bus
-		{
-			BusFrame* cmd = bus_slave_receive(&bus_adcs);
-			if (cmd != NULL) {
-				BusFrame* rsp = bus_get_tx_frame(&bus_adcs);
-				handle_command(cmd, rsp);
-				bus_slave_send(&bus_adcs, rsp);
-			}
-		}
-
-		TB0CTL |= TBCLR;
-
-		// Processor wakes up every 16ms --> Goes to sleep after 16ms*250 = 4s
-		if (idle_counter > 250 && !sleep_mode) {
-			// Goto "deepsleep" if rs485 is not actively used
-			sleepmode();
-		}
-		else {
-			idle_counter++;
-			// Resets itself after 16ms*1250 = 20s
-			if (idle_counter >= 1250) {
-				// Trigger POR reset after ~20 seconds of idling
-				PMMCTL0 |= PMMSWPOR;
-			}
-		}
+	arm_sun_monitor();
+
+	// Spin mode may have been enabled
+	if (SPIN_ACTIVE())
+		sched_post(EV_SPIN);
+}
+
+#ifdef SPIN_MODE
+// Spin mode keeps sampling and sleeps only during the conversions
+static void spin_step(uint16_t events) {
+#ifdef CLOCK_SCALING
+	// The scheduler does not idle in spin mode, sample in the idle profile
+	__disable_interrupt();
+	if (bus_idle())
+		clock_switch(CLOCK_IDLE);
+	__enable_interrupt();
+#endif
+	spin_task();
+	reset_idle_counter();
+	arm_sun_monitor();
+	RESET_WDT();
+
+	if (SPIN_ACTIVE())
+		sched_post(EV_SPIN);
+}
+#endif
+
+static void monitor_task(uint16_t events) {
+	monitor_sun();
+	arm_sun_monitor();
+}
+
+static void idle_task(uint16_t events) {
+	// Goto "deepsleep" if rs485 is not actively used
+	if ((events & EV_SLEEP) && !sleep_mode)
+		sleepmode();
+
+	if (events & EV_IDLE_RESET) {
+		// Trigger POR reset after ~20 seconds of idling
+#ifdef WARM_RESTART
+		warm_save(&bus_adcs);
+#endif
+		PMMCTL0 = PMMPW | PMMSWPOR; // PMMPW reads as 0x96, |= would be a password violation
 	}
 }
 
+/*
+ * Housekeeping tasks in priority order: events, function, WCET, deadline.
+ * The table entries and their deadline checks are made from the same list.
+ *
+ * The bus task is first in the table, so a received frame waits at most for
+ * one housekeeping task already running: its response time is bounded by
+ * the longest housekeeping WCET plus its own. A housekeeping task waits at
+ * most for each other task once, as no event recurs within the sum of the
+ * WCETs (a frame is answered before the next one is sent, the timers post
+ * every systick at most), so its response time is bounded by the sum.
+ */
+#ifdef SPIN_MODE
+#define SPIN_TASK(TASK) TASK(EV_SPIN, spin_step, SPIN_TASK_WCET, SPIN_TASK_DEADLINE)
+#else
+#define SPIN_TASK(TASK)
+#endif
+
+#define HOUSEKEEPING_TASKS(TASK) \
+	SPIN_TASK(TASK) \
+	TASK(EV_SUN_MONITOR, monitor_task, MONITOR_TASK_WCET, MONITOR_TASK_DEADLINE) \
+	TASK(EV_SLEEP | EV_IDLE_RESET, idle_task, IDLE_TASK_WCET, IDLE_TASK_DEADLINE)
+
+#define TASK_ENTRY(events, run, wcet, deadline) { events, run, wcet, deadline },
+#define TASK_WCET_SUM(events, run, wcet, deadline) + (wcet)
+
+enum { TASKS_WCET_SUM = BUS_TASK_WCET HOUSEKEEPING_TASKS(TASK_WCET_SUM) };
+
+#define TASK_DEADLINE(events, run, wcet, deadline) \
+	_Static_assert(BUS_TASK_WCET + (wcet) <= BUS_TASK_DEADLINE, #run " delays bus responses past their deadline"); \
+	_Static_assert(TASKS_WCET_SUM <= (deadline), #run " may miss its deadline");
+
+HOUSEKEEPING_TASKS(TASK_DEADLINE)
+
+// In priority order, bus responses preempt the housekeeping
+static const sched_task_t tasks[] = {
+	{ EV_BUS, bus_task, BUS_TASK_WCET, BUS_TASK_DEADLINE },
+	HOUSEKEEPING_TASKS(TASK_ENTRY)
+};
+
+static void platform_loop() {
+	BusDriver bus_driver = { 0 };
+	bus_adcs.driver = &bus_driver;
+
+	arm_sun_monitor();
+	if (SPIN_ACTIVE())
+		sched_post(EV_SPIN);
+
+	sched_run(tasks, sizeof(tasks) / sizeof(tasks[0]));
+}
+
 int main() {
     platform_init();
     platform_loop();
@@ -3,13 +3,20 @@
 
 #include <stdint.h>
 
+#include "timestamp.h"
+
 extern uint8_t sleep_mode;
+extern uint16_t bus_rx_timeout;
+#ifdef TIME_SYNC
+extern uint16_t bus_sync_ticks;
+#endif
 
 #define USE_WDT
 
 // Heartbeat Timer
-#define HB_TIMER_ENABLE() TB0CTL |= MC_1
-#define HB_TIMER_DISABLE() TB0CTL &= ~MC_1
+#define HEARTBEAT_TICKS (1 << TICK_SHIFT) // Timer ticks per systick
+#define HB_TIMER_ENABLE() TB0CTL |= MC__CONTINUOUS
+#define HB_TIMER_DISABLE() TB0CTL &= ~MC__CONTINUOUS
 
 // OPAMP Enable
 #define OPAMP_ON()  do { P2OUT |=  BIT0; } while(0)
@@ -27,11 +34,11 @@ extern uint8_t sleep_mode;
 #define LED_TOGGLE()
 #endif
 
-void configure_clocks(void);
+void configure_clocks(uint16_t dco_trim);
 void init_gpio(void);
 void reset_idle_counter(void);
 void sleepmode(void);
 void wakeup(void);
-void init_heartbeat_timer(void);
+void init_heartbeat_timer(uint32_t start);
 
 #endif /* __MAIN_H__ */
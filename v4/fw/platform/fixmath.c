@@ -0,0 +1,112 @@
+#include "fixmath.h"
+#include "ramfunc.h"
+
+#ifndef FIXMATH_MPY32
+int32_t fix_mac_sum;
+#endif
+
+#ifdef FIXMATH_COUNT
+fix_counters_t fix_counters;
+#endif
+
+void fix_recip(fix_recip_t* rc, uint16_t d) {
+    uint16_t dn = d;
+    uint8_t k = 0;
+    while (dn < 2048) {
+        dn <<= 1;
+        k++;
+    }
+
+    // 2^27 - 1 is 4095 followed by 15 one bits and 4095 >= dn
+    uint16_t rem = 4095 - dn;
+    uint16_t r = 1;
+    unsigned int i;
+    for (i = 0; i < 15; i++) {
+        FIX_COUNT(loop);
+        rem = (rem << 1) | 1;
+        r <<= 1;
+        if (rem >= dn) {
+            rem -= dn;
+            r |= 1;
+        }
+    }
+
+    FIX_COUNT(div);
+    rc->d = d;
+    rc->r = r;
+    rc->k = k;
+}
+
+RAMFUNC int16_t fix_div_q11(int16_t a, const fix_recip_t* rc) {
+    uint16_t n = (uint16_t)(a >= 0 ? a : -a);
+    uint16_t nk = n << rc->k;
+    uint32_t p = fix_mul_u16(nk, rc->r);
+    uint16_t q = p >> 16;
+
+    // r is truncated, so p is below the exact quotient by less than nk.
+    // Only if the fraction is that close to the next integer can q be
+    // one too small, which is checked with the remainder (~3% of inputs).
+    if ((uint16_t)p > (uint16_t)(0xFFFF - nk) &&
+        ((uint32_t)n << 11) - fix_mul_u16(q, rc->d) >= rc->d)
+        q++;
+
+    return (a >= 0) ? (int16_t)q : -(int16_t)q;
+}
+
+int16_t fix_q15_div(int16_t a, int16_t b) {
+    uint16_t n = (uint16_t)(a >= 0 ? a : -a);
+    uint16_t d = (uint16_t)(b >= 0 ? b : -b);
+    uint16_t q = 0;
+    unsigned int i;
+    FIX_COUNT(div);
+
+    // n < d <= 32768, so the remainder never needs more than 17 bits
+    uint32_t rem = n;
+    for (i = 0; i < 15; i++) {
+        FIX_COUNT(loop);
+        rem <<= 1;
+        q <<= 1;
+        if (rem >= d) {
+            rem -= d;
+            q |= 1;
+        }
+    }
+
+    return ((a < 0) != (b < 0)) ? -(int16_t)q : (int16_t)q;
+}
+
+// 1 / sqrt(M) in Q14 in the middle of M = [(i + 8) / 32, (i + 9) / 32)
+static const uint16_t rsqrt_seed[24] = {
+    31831, 30101, 28627, 27350, 26230, 25238, 24350, 23550,
+    22825, 22162, 21554, 20993, 20475, 19992, 19543, 19122,
+    18727, 18356, 18007, 17676, 17363, 17066, 16784, 16515,
+};
+
+uint16_t fix_rsqrt(uint32_t s, uint8_t* shift) {
+    if (s == 0) {
+        *shift = 0;
+        return 0;
+    }
+
+    // Normalize into [2^30, 2^32), every 4x halves the inverse square root
+    uint8_t j = 0;
+    while (s < 0x40000000UL) {
+        FIX_COUNT(loop);
+        s <<= 2;
+        j++;
+    }
+
+    uint16_t m = s >> 16; // M in Q16, [0.25, 1)
+    uint16_t y = rsqrt_seed[(m >> 11) - 8];
+
+    // Two Newton-Raphson steps y = y * (3 - M * y^2) / 2 from a seed within 3%
+    unsigned int i;
+    for (i = 0; i < 2; i++) {
+        uint16_t my = (fix_mul_u16(m, y) + 0x4000) >> 15;      // Q15
+        uint16_t h = ((3UL << 29) - fix_mul_u16(my, y)) >> 15;  // Q15, (3 - M * y^2) / 2
+        y = (fix_mul_u16(y, h) + 0x4000) >> 15;
+    }
+
+    *shift = 15 - j;
+    return y;
+}
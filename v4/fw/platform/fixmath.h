@@ -0,0 +1,246 @@
+#ifndef FIXMATH_H
+#define FIXMATH_H
+
+#include <stdint.h>
+
+#ifdef __MSP430__
+#include <msp430.h>
+#endif
+
+// FIXMATH_SOFTWARE uses the fallback on MPY32 devices too, to measure it
+#if defined(__MSP430_HAS_MPY32__) && !defined(FIXMATH_SOFTWARE)
+#define FIXMATH_MPY32
+#endif
+
+/*
+ * Fixed-point math primitives on the MPY32 hardware multiplier.
+ *
+ * The firmware is built with -mhwmult=none, so the compiler never touches
+ * the multiplier on its own and these primitives own it. Every primitive
+ * loads the operands and reads the result with interrupts disabled, so an
+ * ISR cannot corrupt an operation in flight. The multiply-accumulate sum
+ * lives in the result registers between fix_mac_s16() calls, so an ISR
+ * using the multiplier must wrap its use in MPY_SAVE()/MPY_RESTORE().
+ *
+ * Builds without MPY32 (e.g. host builds) or with FIXMATH_SOFTWARE use plain
+ * C with identical results.
+ *
+ * Estimated cycles per call at -Os, counted from the generated instruction
+ * sequences (MPY32) and the libgcc loops (-mhwmult=none). A PROFILER build
+ * measures them on the target: tools/cycles.py prints the MPY32 column, and
+ * of a FIXMATH_SOFTWARE build the software column. The table is to be
+ * replaced with those counts:
+ *
+ *   primitive          MPY32   software
+ *   fix_mul_u16          ~20     ~150
+ *   fix_mul_s16          ~20     ~170
+ *   fix_mul_s32_s16      ~30     ~300
+ *   fix_q15_mul          ~30     ~190
+ *   fix_mac_s16          ~15     ~180
+ *   fix_q31_mul          ~45     ~650
+ *   fix_div_q11         ~160     ~450 (one 32-bit division)
+ *   fix_rsqrt           ~250    ~1000
+ */
+
+/*
+ * Operation counters for the host benchmark (v4/fw/host).
+ * FIX_COUNT() compiles to nothing in the firmware.
+ */
+#ifdef FIXMATH_COUNT
+typedef struct {
+    uint32_t mul;   // Multiplications and multiply-accumulates
+    uint32_t div;   // Divisions and reciprocals
+    uint32_t loop;  // Iterations of the shift-add and shift-subtract loops
+} fix_counters_t;
+
+extern fix_counters_t fix_counters;
+#define FIX_COUNT(op) (fix_counters.op++)
+#else
+#define FIX_COUNT(op) ((void)0)
+#endif
+
+#ifdef FIXMATH_MPY32
+
+#define FIX_ATOMIC_BEGIN() uint16_t fix_sr = __get_interrupt_state(); __disable_interrupt()
+#define FIX_ATOMIC_END()   __set_interrupt_state(fix_sr)
+
+typedef struct {
+    uint16_t ctl;
+    uint16_t res0, res1, res2, res3;
+} mpy_state_t;
+
+/* Save and restore multiplier state in an ISR that uses the multiplier */
+#define MPY_SAVE(s) do { \
+        (s).ctl = MPY32CTL0; \
+        (s).res0 = RES0; (s).res1 = RES1; (s).res2 = RES2; (s).res3 = RES3; \
+    } while (0)
+
+#define MPY_RESTORE(s) do { \
+        RES0 = (s).res0; RES1 = (s).res1; RES2 = (s).res2; RES3 = (s).res3; \
+        MPY32CTL0 = (s).ctl; \
+    } while (0)
+
+/* Unsigned 16 x 16 -> 32 */
+static inline uint32_t fix_mul_u16(uint16_t a, uint16_t b) {
+    FIX_ATOMIC_BEGIN();
+    MPY = a;
+    OP2 = b;
+    uint32_t r = ((uint32_t)RESHI << 16) | RESLO;
+    FIX_ATOMIC_END();
+    return r;
+}
+
+/* Signed 16 x 16 -> 32 */
+static inline int32_t fix_mul_s16(int16_t a, int16_t b) {
+    FIX_ATOMIC_BEGIN();
+    MPYS = a;
+    OP2 = b;
+    int32_t r = (int32_t)(((uint32_t)RESHI << 16) | RESLO);
+    FIX_ATOMIC_END();
+    return r;
+}
+
+/* Signed 32 x 16, low 32 bits of the product */
+static inline int32_t fix_mul_s32_s16(int32_t a, int16_t b) {
+    FIX_ATOMIC_BEGIN();
+    MPYS32L = (uint16_t)a;
+    MPYS32H = (uint16_t)(a >> 16);
+    OP2 = b;
+    int32_t r = (int32_t)(((uint32_t)RES1 << 16) | RES0);
+    FIX_ATOMIC_END();
+    return r;
+}
+
+/* Q15 x Q15 -> Q15, saturated (-1 * -1 gives 0x7FFF) */
+static inline int16_t fix_q15_mul(int16_t a, int16_t b) {
+    FIX_ATOMIC_BEGIN();
+    MPY32CTL0 |= MPYFRAC | MPYSAT;
+    MPYS = a;
+    OP2 = b;
+    int16_t r = (int16_t)RESHI;
+    MPY32CTL0 &= ~(MPYFRAC | MPYSAT);
+    FIX_ATOMIC_END();
+    return r;
+}
+
+/* Q31 x Q31 -> Q31, truncated */
+static inline int32_t fix_q31_mul(int32_t a, int32_t b) {
+    FIX_ATOMIC_BEGIN();
+    MPYS32L = (uint16_t)a;
+    MPYS32H = (uint16_t)(a >> 16);
+    OP2L = (uint16_t)b;
+    OP2H = (uint16_t)(b >> 16);
+    uint32_t hi = ((uint32_t)RES3 << 16) | RES2;
+    uint16_t lo = RES1;
+    FIX_ATOMIC_END();
+    return (int32_t)((hi << 1) | (lo >> 15));
+}
+
+/* Clear the multiply-accumulate sum */
+static inline void fix_mac_clear(void) {
+    FIX_ATOMIC_BEGIN();
+    RESLO = 0;
+    RESHI = 0;
+    FIX_ATOMIC_END();
+}
+
+/* Add signed 16 x 16 product to the sum */
+static inline void fix_mac_s16(int16_t a, int16_t b) {
+    FIX_ATOMIC_BEGIN();
+    MACS = a;
+    OP2 = b;
+    FIX_ATOMIC_END();
+}
+
+/* Read the multiply-accumulate sum */
+static inline int32_t fix_mac_result(void) {
+    FIX_ATOMIC_BEGIN();
+    int32_t r = (int32_t)(((uint32_t)RESHI << 16) | RESLO);
+    FIX_ATOMIC_END();
+    return r;
+}
+
+#else /* Software fallback */
+
+typedef struct { uint8_t unused; } mpy_state_t;
+#define MPY_SAVE(s)     do { (void)(s); } while (0)
+#define MPY_RESTORE(s)  do { (void)(s); } while (0)
+
+extern int32_t fix_mac_sum;
+
+static inline uint32_t fix_mul_u16(uint16_t a, uint16_t b) {
+    FIX_COUNT(mul);
+    return (uint32_t)a * b;
+}
+
+static inline int32_t fix_mul_s16(int16_t a, int16_t b) {
+    FIX_COUNT(mul);
+    return (int32_t)a * b;
+}
+
+static inline int32_t fix_mul_s32_s16(int32_t a, int16_t b) {
+    FIX_COUNT(mul);
+    return (int32_t)((uint32_t)a * (uint32_t)(int32_t)b);
+}
+
+static inline int16_t fix_q15_mul(int16_t a, int16_t b) {
+    FIX_COUNT(mul);
+    int32_t r = ((int32_t)a * b) >> 15;
+    return (r > INT16_MAX) ? INT16_MAX : (int16_t)r;
+}
+
+static inline int32_t fix_q31_mul(int32_t a, int32_t b) {
+    FIX_COUNT(mul);
+    return (int32_t)(((int64_t)a * b) >> 31);
+}
+
+static inline void fix_mac_clear(void) {
+    fix_mac_sum = 0;
+}
+
+static inline void fix_mac_s16(int16_t a, int16_t b) {
+    FIX_COUNT(mul);
+    fix_mac_sum += (int32_t)a * b;
+}
+
+static inline int32_t fix_mac_result(void) {
+    return fix_mac_sum;
+}
+
+#endif /* FIXMATH_MPY32 */
+
+/*
+ * Reciprocal of a divisor (1 - 4095) for fix_div_q11().
+ */
+typedef struct {
+    uint16_t d;     // Divisor
+    uint16_t r;     // floor((2^27 - 1) / (d << k))
+    uint8_t k;      // Normalization shift, d << k is in [2048, 4096)
+} fix_recip_t;
+
+/*
+ * Prepare the reciprocal of d with a 15 step shift-subtract loop.
+ * One reciprocal serves any number of fix_div_q11() calls with the same divisor.
+ */
+void fix_recip(fix_recip_t* rc, uint16_t d);
+
+/*
+ * (a << 11) / d rounded towards zero like the C division.
+ * Bit-identical to the division for |a| <= d.
+ */
+int16_t fix_div_q11(int16_t a, const fix_recip_t* rc);
+
+/*
+ * (a << 15) / b rounded towards zero, for |a| < |b|.
+ * Shift-subtract on 16-bit values, no multiplier needed.
+ */
+int16_t fix_q15_div(int16_t a, int16_t b);
+
+/*
+ * Inverse square root with a seed table and two Newton-Raphson steps.
+ * x / sqrt(s) in Q15 is (x * r) >> shift, accurate to ~2^-14.
+ * Returns 0 for s = 0.
+ */
+uint16_t fix_rsqrt(uint32_t s, uint8_t* shift);
+
+#endif /* FIXMATH_H */
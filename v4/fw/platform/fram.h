@@ -0,0 +1,30 @@
+#ifndef FRAM_H
+#define FRAM_H
+
+#include <msp430.h>
+
+/*
+ * FRAM write protection around writes to FRAM variables.
+ *
+ * SYSCFG0 is volatile, the variables written in between are not: GCC may
+ * move their stores past the relock, where the device silently drops
+ * them. The barrier keeps every memory access inside the unlocked window.
+ */
+
+#if defined(__GNUC__)
+#define FRAM_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+#define FRAM_BARRIER()
+#endif
+
+static inline void fram_unlock(void) {
+    SYSCFG0 = FRWPPW; // Disable FRAM write protection
+    FRAM_BARRIER();
+}
+
+static inline void fram_lock(void) {
+    FRAM_BARRIER();
+    SYSCFG0 = FRWPPW | DFWP | PFWP;  // Re-enable FRAM write protection
+}
+
+#endif /* FRAM_H */
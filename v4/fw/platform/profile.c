@@ -0,0 +1,38 @@
+#include "profile.h"
+#include "clock.h"
+
+#ifdef PROFILER
+
+profile_entry_t profile_table[PROF_REGIONS];
+
+void profile_record(uint8_t region, uint16_t ticks) {
+    profile_entry_t* entry = &profile_table[region];
+
+#ifdef CLOCK_SCALING
+    // Ticks of different lengths do not mix
+    if (entry->clock != clock_profile)
+        entry->count = 0;
+    entry->clock = clock_profile;
+#endif
+
+    if (entry->count == 0) {
+        entry->min = entry->max = entry->mean = ticks;
+    }
+    else {
+        if (ticks < entry->min)
+            entry->min = ticks;
+        if (ticks > entry->max)
+            entry->max = ticks;
+        entry->mean += ((int32_t)ticks - entry->mean) >> 3;
+    }
+
+    if (entry->count < UINT16_MAX)
+        entry->count++;
+}
+
+void profile_reset() {
+    for (uint8_t i = 0; i < PROF_REGIONS; i++)
+        profile_table[i].count = 0;
+}
+
+#endif /* PROFILER */
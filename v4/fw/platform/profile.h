@@ -0,0 +1,63 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Timer profiler for the hot paths.
+ *
+ * Regions are timed in ticks of the free-running Timer B1 (SMCLK / 8,
+ * 1 tick = 8 SMCLK cycles, 1 us at 8 MHz) and the min, max and running
+ * mean of each region are kept in profile_table. Without PROFILER the
+ * macros compile to nothing.
+ *
+ * With CLOCK_SCALING the tick length follows the clock profile (4 us
+ * idle, 1 us burst). Each entry holds the profile its ticks were measured
+ * in and restarts when a region runs in another one.
+ *
+ * A region must be shorter than the timer period (65 ms at 8 MHz). The
+ * timer reads and the bookkeeping add a few ticks to each region.
+ */
+
+/* Profiled regions */
+#define PROF_RX_ISR         0 // Received byte interrupt
+#define PROF_COMMAND        1 // handle_command()
+#define PROF_SAMPLE         2 // read_voltage_channels()
+#define PROF_POSITION       3 // calculate_position()
+#define PROF_ANGLES         4 // calculate_angles()
+#define PROF_TX_PREPARE     5 // bus_prepare_tx_frame()
+#define PROF_TX             6 // Response from the first byte to transmit complete
+#define PROF_REGIONS        7
+
+typedef struct {
+    uint16_t min, max;  // [ticks]
+    uint16_t mean;      // Running mean over 8 calls [ticks]
+    uint16_t count;     // Calls, saturates
+    uint8_t clock;      // Clock profile of the ticks, 0 without CLOCK_SCALING
+} profile_entry_t;
+
+#ifdef PROFILER
+
+#include <msp430.h>
+
+extern profile_entry_t profile_table[PROF_REGIONS];
+
+#define PROFILE_NOW()                   (TB1R)
+#define PROFILE_START(region)           uint16_t profile_start_##region = PROFILE_NOW()
+#define PROFILE_STOP(region)            profile_record(region, PROFILE_NOW() - profile_start_##region)
+#define PROFILE_RECORD(region, ticks)   profile_record(region, ticks)
+
+void profile_record(uint8_t region, uint16_t ticks);
+
+/* Clear the table */
+void profile_reset(void);
+
+#else
+
+#define PROFILE_START(region)
+#define PROFILE_STOP(region)
+#define PROFILE_RECORD(region, ticks)
+
+#endif /* PROFILER */
+
+#endif /* PROFILE_H */
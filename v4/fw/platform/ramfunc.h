@@ -0,0 +1,33 @@
+#ifndef RAMFUNC_H
+#define RAMFUNC_H
+
+/*
+ * Placement of hot functions in RAM (RAM_CODE).
+ *
+ * Above 8 MHz every FRAM access that misses the cache costs a wait state
+ * (NWAITS_1 of the CLOCK_SCALING burst profile), RAM runs at full speed.
+ * RAMFUNC functions are linked to run from RAM and copied from FRAM at
+ * startup: the .ramtext input section is part of .data in msp430fr2311.ld,
+ * CCS uses its own .TI.ramfunc section (lnk_msp430fr2311.cmd).
+ *
+ * Every placed item costs its size of the 1 KB RAM, `make memreport`
+ * lists the cost against the estimated cycles saved. Tables stay in FRAM:
+ * the two bus frames take half of the RAM, so the 512-byte CRC table
+ * would leave too little for the stack.
+ */
+
+#ifdef RAM_CODE
+
+#if defined(__TI_COMPILER_VERSION__)
+#define RAMFUNC __attribute__ ((ramfunc))
+#elif defined(__GNUC__)
+#define RAMFUNC __attribute__ ((section(".ramtext"), noinline))
+#else
+#error Compiler not supported!
+#endif
+
+#else
+#define RAMFUNC
+#endif /* RAM_CODE */
+
+#endif /* RAMFUNC_H */
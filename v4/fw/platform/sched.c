@@ -0,0 +1,77 @@
+#include <msp430.h>
+
+#include "sched.h"
+#include "timestamp.h"
+
+volatile uint16_t sched_events = 0;
+
+static struct {
+    uint16_t expires; // Systick
+    uint16_t events;  // 0 if stopped
+} timers[SCHED_TIMERS];
+
+void sched_timer_start(uint8_t timer, uint16_t delay, uint16_t events) {
+    timers[timer].expires = sys_ticks + delay;
+    timers[timer].events = events;
+}
+
+void sched_timer_stop(uint8_t timer) {
+    timers[timer].events = 0;
+}
+
+int sched_timer_active(uint8_t timer) {
+    return timers[timer].events != 0;
+}
+
+/*
+ * Post the events of the expired timers.
+ * Returns 1 and the earliest expiry of the running timers if any.
+ */
+static uint8_t expire_timers(uint16_t* deadline) {
+    uint8_t timed = 0;
+    for (uint8_t i = 0; i < SCHED_TIMERS; i++) {
+        if (timers[i].events == 0)
+            continue;
+        int16_t ahead = timers[i].expires - sys_ticks;
+        if (ahead <= 0) {
+            sched_post(timers[i].events);
+            timers[i].events = 0;
+        }
+        else if (!timed || (int16_t)(timers[i].expires - *deadline) < 0) {
+            *deadline = timers[i].expires;
+            timed = 1;
+        }
+    }
+    return timed;
+}
+
+void sched_run(const sched_task_t* tasks, uint8_t count) {
+    for (;;) {
+#ifdef TICKLESS_IDLE
+        sys_ticks = get_timer_ticks() >> TICK_SHIFT;
+#endif
+        uint16_t deadline = 0;
+        uint8_t timed = expire_timers(&deadline);
+
+        // Highest priority task with pending events
+        uint16_t events = sched_events;
+        uint8_t i = 0;
+        while (i < count && !(events & tasks[i].events))
+            i++;
+
+        if (i < count) {
+            events &= tasks[i].events;
+            __disable_interrupt();
+            sched_events &= ~events;
+            __enable_interrupt();
+            tasks[i].run(events);
+            continue;
+        }
+
+        // Make sure that all interrupts are serviced before going to sleep
+        __disable_interrupt();
+        if (sched_events == 0)
+            sched_idle(deadline, timed);
+        __enable_interrupt();
+    }
+}
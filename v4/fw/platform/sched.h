@@ -0,0 +1,58 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/*
+ * Cooperative event scheduler.
+ *
+ * Interrupts post event bits with sched_post(). The tasks are a static
+ * table in priority order, the first task with a pending event runs to
+ * completion and the table is scanned again from the top. Timers post
+ * their events at a systick. With no events pending the platform idle
+ * hook sleeps until the next timer or an interrupt.
+ *
+ * Response time: a task is delayed by at most one lower priority task
+ * already running and by the higher priority tasks. For the first task
+ * of the table, posted from an interrupt:
+ *   latency <= max(wcet of the other tasks)
+ *   response <= latency + own wcet <= deadline
+ * The application checks the bounds of its table at compile time.
+ */
+
+#ifndef SCHED_TIMERS
+#define SCHED_TIMERS 4
+#endif
+
+typedef struct {
+    uint16_t events;             // Event bits the task handles
+    void (*run)(uint16_t events); // Called with the pending events of the task
+    uint16_t wcet;               // Worst-case run time [ms]
+    uint16_t deadline;           // Longest time from the event to the end of the run [ms]
+} sched_task_t;
+
+extern volatile uint16_t sched_events;
+
+/* Post events, also from interrupts */
+#define sched_post(events) (sched_events |= (events))
+
+/*
+ * Post the events after delay systicks. Restarts the timer if running.
+ */
+void sched_timer_start(uint8_t timer, uint16_t delay, uint16_t events);
+void sched_timer_stop(uint8_t timer);
+int sched_timer_active(uint8_t timer);
+
+/*
+ * Run the tasks forever.
+ */
+void sched_run(const sched_task_t* tasks, uint8_t count);
+
+/*
+ * Platform idle hook. Called with interrupts disabled when no event is
+ * pending, sleeps until the deadline (systick, if timed) or an interrupt
+ * and returns with interrupts enabled.
+ */
+void sched_idle(uint16_t deadline, uint8_t timed);
+
+#endif /* SCHED_H */
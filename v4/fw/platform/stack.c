@@ -0,0 +1,40 @@
+#include "stack.h"
+
+#include <msp430.h>
+
+#ifdef STACK_MONITOR
+
+#define STACK_PAINT     0xC0DE
+#define RAM_START       0x2000
+
+// Ends of the area the stack may grow into
+#if defined(__TI_COMPILER_VERSION__)
+extern uint16_t _stack, __STACK_END;
+#define STACK_BOTTOM    (&_stack)
+#define STACK_TOP       (&__STACK_END)
+#elif defined(__GNUC__)
+extern uint16_t __heap_end__, __stack;
+#define STACK_BOTTOM    (&__heap_end__)
+#define STACK_TOP       (&__stack)
+#else
+#error Compiler not supported!
+#endif
+
+void stack_paint() {
+    // Leave a few words for the frame of this function
+    uint16_t* end = (uint16_t*)__get_SP_register() - 4;
+    for (uint16_t* p = STACK_BOTTOM; p < end; p++)
+        *p = STACK_PAINT;
+}
+
+void stack_get_stats(stack_stats_t* stats) {
+    uint16_t* p = STACK_BOTTOM;
+    while (p < STACK_TOP && *p == STACK_PAINT)
+        p++;
+
+    stats->static_ram = (uint16_t)((uintptr_t)STACK_BOTTOM - RAM_START);
+    stats->stack_size = (uint16_t)((uint8_t*)STACK_TOP - (uint8_t*)STACK_BOTTOM);
+    stats->stack_used = (uint16_t)((uint8_t*)STACK_TOP - (uint8_t*)p);
+}
+
+#endif /* STACK_MONITOR */
@@ -0,0 +1,29 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include <stdint.h>
+
+/*
+ * Stack high-water mark (STACK_MONITOR). The free RAM between the static
+ * data and the stack is painted at boot and scanned for the deepest
+ * word the stack (including nested interrupts) has overwritten.
+ */
+
+typedef struct {
+    uint16_t static_ram;    // .data, .bss and .noinit [bytes]
+    uint16_t stack_size;    // Free RAM for the stack [bytes]
+    uint16_t stack_used;    // High-water mark [bytes]
+} stack_stats_t;
+
+#ifdef STACK_MONITOR
+
+/*
+ * Paint the stack area below the caller. Call first thing at boot.
+ */
+void stack_paint(void);
+
+void stack_get_stats(stack_stats_t* stats);
+
+#endif /* STACK_MONITOR */
+
+#endif /* STACK_H */
@@ -1,5 +1,127 @@
+#include <msp430.h>
+
 #include "timestamp.h"
+#include "fixmath.h"
+#include "fram.h"
+
+volatile uint16_t timer_overflows = 0;
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(time_config)
+#endif
+time_config_t time_config = {
+    .rate = 0
+};
+
+timebase_t timebase;
+
+uint32_t get_timer_ticks(void) {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    uint16_t high = timer_overflows;
+    uint16_t low;
+
+    // The timer clock is asynchronous to MCLK, read until two reads agree
+    do {
+        low = TB0R;
+    } while (low != TB0R);
+
+    // Overflow not serviced yet
+    if ((TB0CTL & TBIFG) && low < 0x8000)
+        high++;
+
+    __set_interrupt_state(state);
+    return ((uint32_t)high << 16) | low;
+}
 
 timestamp_t get_timestamp(void) {
-    return sys_ticks<<4; // shift 4 to multiply by 2^4 to get 1 ms
+    // 1 ms = 4096/125 ticks. The product wraps after 17 minutes but its
+    // low bits, and so the 16-bit timestamp, stay exact.
+    uint32_t ticks = get_timer_ticks();
+    return ((ticks << 7) - (ticks << 2) + ticks) >> 12;
+}
+
+// e * rate / 2^20 for |e| < 2^31, as two 16-bit multiplications
+static int32_t rate_correction(int32_t elapsed) {
+    int16_t high = (int16_t)(elapsed >> 16);
+    uint16_t low = (uint16_t)elapsed;
+    return (fix_mul_s16(high, time_config.rate) >> 4) +
+           (fix_mul_s16((int16_t)(low >> 1), time_config.rate) >> 19);
+}
+
+uint32_t timer_to_time(uint32_t ticks) {
+    int32_t elapsed = (int32_t)(ticks - timebase.epoch);
+    return timebase.offset + (uint32_t)elapsed + (uint32_t)rate_correction(elapsed);
+}
+
+void time_rebase() {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    uint32_t ticks = get_timer_ticks();
+    timebase.offset = timer_to_time(ticks);
+    timebase.epoch = ticks;
+
+    __set_interrupt_state(state);
 }
+
+uint32_t get_time(void) {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    uint32_t ticks = get_timer_ticks();
+
+    // Keep the epoch within 2^30 ticks (9 h) so earlier timer values convert too
+    if (ticks - timebase.epoch >= 0x40000000UL)
+        time_rebase();
+    uint32_t time = timer_to_time(ticks);
+
+    __set_interrupt_state(state);
+    return time;
+}
+
+#ifdef TIME_SYNC
+
+#define SYNC_ERROR_MAX      2048    // Larger errors only step the time [ticks], 62 ms
+#define SYNC_INTERVAL_MIN   32768   // Shorter intervals give a noisy rate [ticks], 1 s
+
+static uint32_t last_sync;
+static uint8_t synced;
+
+int32_t time_sync(uint32_t master, uint16_t latched) {
+    uint16_t state = __get_interrupt_state();
+    __disable_interrupt();
+
+    uint32_t now = get_timer_ticks();
+    uint32_t ticks = now - (uint16_t)((uint16_t)now - latched);
+    int32_t error = (int32_t)(master - timer_to_time(ticks));
+    uint32_t interval = ticks - last_sync;
+
+    // The time was right at the previous sync, so the error grew with the
+    // frequency error over the interval
+    if (synced && error > -SYNC_ERROR_MAX && error < SYNC_ERROR_MAX &&
+        interval >= SYNC_INTERVAL_MIN && interval < 0x40000000UL) {
+        int32_t rate = time_config.rate + ((error << 20) / (int32_t)interval) / 2;
+        if (rate > INT16_MAX)
+            rate = INT16_MAX;
+        else if (rate < INT16_MIN)
+            rate = INT16_MIN;
+
+        fram_unlock();
+        time_config.rate = (int16_t)rate;
+        fram_lock();
+    }
+
+    timebase.epoch = ticks;
+    timebase.offset = master;
+    last_sync = ticks;
+    synced = 1;
+
+    __set_interrupt_state(state);
+    return error;
+}
+
+#endif /* TIME_SYNC */
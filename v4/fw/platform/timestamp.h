@@ -3,14 +3,67 @@
 
 #include <stdint.h>
 
-// Systick (1 systick = 16 ms)
+// Timer B0 counts ACLK (REFO, 32768 Hz) continuously
+#define TIMER_HZ    32768UL
+#define TICK_SHIFT  9 // 1 systick = 2^9 timer ticks = 15.6 ms
+
+// Systick (1 systick = 15.6 ms)
 extern volatile uint16_t sys_ticks;
 
+// Timer B0 overflows (1 overflow = 2 s), the upper half of get_timer_ticks()
+extern volatile uint16_t timer_overflows;
+
+/*
+ * Milliseconds of the raw timer, wrapping after 65 s. For intervals only
+ * (the sample and temperature age, the tracker steps): a sync steps the
+ * local time by its error, which would show as a jump in the interval,
+ * and the rate correction is below 0.1 % of one. Times reported to the
+ * OBC are local time, see get_time().
+ */
 typedef uint16_t timestamp_t;
 
 #define TIMESTAMP_MS  (1)
 //#define TIMESTAMP_SEC (TIMESTAMP_MS * 1000)
 
+/*
+ * Local time in timer ticks (1/32768 s, wraps after 36 h), corrected for
+ * the REFO frequency error: time = offset + e + e * rate / 2^20, where e
+ * is the timer ticks elapsed since the epoch.
+ */
+typedef struct {
+    int16_t rate;       // Rate correction [2^-20, ~0.95 ppm], +-3.1 %
+} time_config_t;
+
+typedef struct {
+    uint32_t epoch;     // Timer ticks at the last rebase
+    uint32_t offset;    // Local time at the epoch
+} timebase_t;
+
+extern time_config_t time_config; // Stored in FRAM
+extern timebase_t timebase;
+
+uint32_t get_timer_ticks(void);
 timestamp_t get_timestamp(void);
 
+/*
+ * Local time now, or of a timer value taken within ~9 h of now.
+ */
+uint32_t get_time(void);
+uint32_t timer_to_time(uint32_t ticks);
+
+/*
+ * Move the epoch to now, before the rate or offset is changed.
+ */
+void time_rebase(void);
+
+#ifdef TIME_SYNC
+/*
+ * Discipline the local time to the master time, taken at the timer value
+ * latched within the last timer period (2 s). The offset is set to the
+ * master time and the rate corrected by half of the frequency error seen
+ * since the previous sync. Returns the local time error before the sync.
+ */
+int32_t time_sync(uint32_t master, uint16_t latched);
+#endif
+
 #endif
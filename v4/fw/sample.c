@@ -0,0 +1,120 @@
+#include "sample.h"
+#include "main.h"
+#include "calc.h"
+#include "adc.h"
+#include "fixmath.h"
+#include "profile.h"
+
+#ifdef DEBUG
+#define SAMPLING_LED_ON()  LED_ON()
+#define SAMPLING_LED_OFF() LED_OFF()
+#else
+#define SAMPLING_LED_ON()
+#define SAMPLING_LED_OFF()
+#endif
+
+sample_record_t sample;
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(sampling_config)
+#endif
+sampling_config_t sampling_config = {
+    .max_age = 0,
+    .sun_on = 0,
+    .sun_off = 0,
+    .latency = 0,
+    .noise = 16,
+    .report_noise = 0,
+    .report_time = 0
+};
+
+void invalidate_sample() {
+    sample.stages = 0;
+}
+
+/*
+ * Pick the number of samples for adaptive oversampling: just enough to reach
+ * the target noise at the intensity of the previous sample, within the
+ * latency budget. Bright light is sampled fast and dim light precisely.
+ */
+static unsigned int adaptive_samples(void) {
+
+    unsigned int max = 1;
+    while (max < SAMPLES_MAX && (max << 1) * SAMPLE_DURATION <= sampling_config.latency)
+        max <<= 1;
+
+    // No previous sample: spend the whole budget
+    if (sample.samples == 0 || position.intensity == 0)
+        return max;
+
+    unsigned int n = 1;
+    uint16_t noise = (uint16_t)(NOISE_K / position.intensity);
+    while (n < max && noise > sampling_config.noise) {
+        n <<= 1;
+        noise = (uint16_t)(fix_mul_u16(noise, 181) >> 8); // 1/sqrt(2)
+    }
+    return n;
+}
+
+static void take_sample(void) {
+    SAMPLING_LED_ON();
+    uint32_t start = get_time();
+    sample.samples = read_voltage_channels(sampling_config.latency ? adaptive_samples() : calibration.samples);
+    sample.capture = start + ((get_time() - start) >> 1);
+    sample.time = get_timestamp();
+    sample.seq++;
+    sample.stages = 0;
+
+    // Position of a sample taken in eclipse would be just noise
+    update_sun_presence();
+    if (sun_present) {
+        // Position is needed by every other stage, so calculate it right away
+        PROFILE_START(PROF_POSITION);
+        calculate_position();
+        PROFILE_STOP(PROF_POSITION);
+        sample.noise = calculate_noise(raw_variance);
+        sample.stages = STAGE_POSITION;
+#ifdef CALC_TRACKER
+        update_tracker(sample.time);
+#endif
+    }
+    SAMPLING_LED_OFF();
+}
+
+int get_measurement(uint8_t stages) {
+
+    // The background sun monitor tells when the sun is back
+    if (!sun_present)
+        return 0;
+
+    // The timestamp wraps around in ~65 s, but the sensor has gone to
+    // sleep mode long before that if there has been no measurements.
+    timestamp_t age = get_timestamp() - sample.time;
+    if (sample.stages == 0 || sleep_mode || sampling_config.max_age == 0 ||
+        age > sampling_config.max_age) {
+        take_sample();
+        if (!sun_present)
+            return 0;
+    }
+
+    stages &= ~sample.stages;
+
+    if (stages & STAGE_VECTOR)
+        calculate_vectors();
+#ifdef CALC_ANGLES
+    if (stages & STAGE_ANGLES) {
+        PROFILE_START(PROF_ANGLES);
+        calculate_angles();
+        PROFILE_STOP(PROF_ANGLES);
+    }
+#endif
+#ifdef CALC_UNIT_VECTOR
+    if (stages & STAGE_UNIT)
+        calculate_unit_vector();
+#endif
+
+    sample.stages |= stages;
+    return 1;
+}
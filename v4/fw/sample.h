@@ -0,0 +1,58 @@
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+
+#include <stdint.h>
+#include "timestamp.h"
+
+/* Derived measurement stages */
+#define STAGE_POSITION  0x01
+#define STAGE_VECTOR    0x02
+#define STAGE_ANGLES    0x04
+#define STAGE_UNIT      0x08
+
+typedef struct {
+    uint16_t max_age; // Maximum age of a cached sample [ms], 0 = always sample
+    uint16_t sun_on;  // Strongest channel level above which the sun is visible
+    uint16_t sun_off; // Strongest channel level below which the sun is lost, 0 = no eclipse detection
+    uint16_t latency; // Sampling time budget for adaptive oversampling [ms], 0 = use calibration.samples
+    uint16_t noise;   // Target position noise for adaptive oversampling [1/16 position LSB]
+    uint16_t report_noise; // Append the measured position noise to measurement responses
+    uint16_t report_time; // Append the capture time and age to measurement responses
+} sampling_config_t;
+
+/*
+ * Position noise with one sample at intensity 1 [1/16 position LSB].
+ * Assumes ~1 LSB of noise on each channel: sigma = 1024 / intensity / sqrt(samples)
+ */
+#define NOISE_K (1024L * 16)
+
+/*
+ * Describes the sample currently held in raw and the derived stages
+ * (position, vector, angles, unit vector) already calculated from it.
+ */
+typedef struct {
+    uint16_t seq;       // Incremented for every new sample
+    timestamp_t time;   // Sample time for the age and the tracker, raw timer [ms]
+    uint32_t capture;   // Capture time, middle of the conversions [1/32768 s local time]
+    uint8_t stages;     // STAGE_* bits valid for this sample, 0 if no sample
+    uint8_t samples;    // Number of samples averaged
+    uint16_t noise;     // Measured position noise [1/16 position LSB], 0xFFFF if unknown
+} sample_record_t;
+
+extern sample_record_t sample;
+extern sampling_config_t sampling_config; // Stored in FRAM
+
+/*
+ * Make the requested stages available. A new sample is taken only if the
+ * cached one is older than sampling_config.max_age, and only the stages
+ * not yet calculated for the sample are calculated.
+ * Returns 0 without sampling if the sensor is in eclipse.
+ */
+int get_measurement(uint8_t stages);
+
+/*
+ * Drop the cached sample, e.g. after calibration has changed.
+ */
+void invalidate_sample(void);
+
+#endif /* __SAMPLE_H__ */
@@ -0,0 +1,156 @@
+#include "spin.h"
+#include "calc.h"
+#include "adc.h"
+#include "sample.h"
+
+#include <string.h>
+
+#ifdef SPIN_MODE
+
+#ifdef NO_CCS
+__attribute__ ((section(".persistent")))
+#else
+#pragma PERSISTENT(spin_config)
+#endif
+spin_config_t spin_config = {
+    .enabled = 0,
+    .threshold = 400,
+    .hysteresis = 100
+};
+
+static spin_event_t queue[SPIN_QUEUE_LEN];
+static uint8_t queue_head, queue_count, queue_dropped;
+
+/*
+ * State of the crossing being tracked.
+ * The peak is the highest sample; its neighbours are kept for interpolation.
+ * Times are timer ticks, the peak is converted to local time at the exit.
+ */
+static struct {
+    uint8_t in_sun;
+    uint8_t have_next;
+    uint32_t entry;
+    uint32_t t_prev, t_peak, t_next;
+    uint16_t i_prev, i_peak, i_next;
+    raw_measurements_t raw_peak;
+    uint32_t t_last;
+    uint16_t i_last;
+} crossing;
+
+void spin_reset() {
+    crossing.in_sun = 0;
+    queue_head = queue_count = queue_dropped = 0;
+}
+
+static void push_event(const spin_event_t* ev) {
+    if (queue_count == SPIN_QUEUE_LEN) {
+        // Drop the oldest
+        queue_head = (queue_head + 1) % SPIN_QUEUE_LEN;
+        queue_count--;
+        if (queue_dropped < 0xFF)
+            queue_dropped++;
+    }
+    queue[(queue_head + queue_count) % SPIN_QUEUE_LEN] = *ev;
+    queue_count++;
+}
+
+unsigned int spin_pop_events(uint8_t* dst, unsigned int max) {
+    unsigned int n = 0;
+    while (n < max && queue_count > 0) {
+        memcpy(dst + n++ * sizeof(spin_event_t), &queue[queue_head], sizeof(spin_event_t));
+        queue_head = (queue_head + 1) % SPIN_QUEUE_LEN;
+        queue_count--;
+    }
+    return n;
+}
+
+uint8_t spin_dropped_events() {
+    uint8_t n = queue_dropped;
+    queue_dropped = 0;
+    return n;
+}
+
+/*
+ * Fit a parabola through the peak and its neighbours and return the time of
+ * its vertex. The offset from the peak sample is within half a sample period.
+ */
+static uint32_t interpolate_peak(void) {
+    int32_t curvature = (int32_t)crossing.i_prev - 2 * (int32_t)crossing.i_peak + crossing.i_next;
+    uint32_t span = crossing.t_next - crossing.t_prev;
+
+    // Neighbours further apart than 2 s (a stalled sampling) are not fitted,
+    // which also keeps slope * span within 32 bits
+    if (!crossing.have_next || curvature >= 0 || span > 0xFFFF)
+        return crossing.t_peak;
+
+    int32_t slope = (int32_t)crossing.i_prev - crossing.i_next;
+    return crossing.t_peak + (uint32_t)((slope * (int32_t)span) / (4 * curvature));
+}
+
+static void end_crossing(uint32_t now) {
+    spin_event_t ev;
+
+    // 1 ms = 4096/125 ticks, saturated from 65.5 s on
+    uint32_t width = now - crossing.entry;
+    ev.width = width < 2147483UL ? (uint16_t)((width * 125) >> 12) : UINT16_MAX;
+
+    ev.time = timer_to_time(interpolate_peak());
+    ev.intensity = crossing.i_peak;
+
+    // Position of the peak sample
+    raw = crossing.raw_peak;
+    calculate_position();
+    ev.x = position.x;
+    ev.y = position.y;
+
+    push_event(&ev);
+}
+
+void spin_task() {
+
+    read_voltage_channels(1);
+    uint32_t now = get_timer_ticks();
+    uint16_t intensity = raw.vx1 + raw.vx2 + raw.vy1 + raw.vy2;
+
+    // Spin sampling overwrites the measurement commands' sample
+    invalidate_sample();
+
+    if (!crossing.in_sun) {
+        if (intensity > spin_config.threshold) {
+            // Sun entry
+            crossing.in_sun = 1;
+            crossing.entry = now;
+            crossing.have_next = 0;
+            crossing.t_prev = crossing.t_last;
+            crossing.i_prev = crossing.i_last;
+            crossing.t_peak = now;
+            crossing.i_peak = intensity;
+            crossing.raw_peak = raw;
+        }
+    }
+    else if (intensity + spin_config.hysteresis < spin_config.threshold) {
+        // Sun exit
+        crossing.in_sun = 0;
+        end_crossing(now);
+    }
+    else if (intensity > crossing.i_peak) {
+        // New peak candidate
+        crossing.have_next = 0;
+        crossing.t_prev = crossing.t_last;
+        crossing.i_prev = crossing.i_last;
+        crossing.t_peak = now;
+        crossing.i_peak = intensity;
+        crossing.raw_peak = raw;
+    }
+    else if (!crossing.have_next) {
+        // First sample after the peak
+        crossing.have_next = 1;
+        crossing.t_next = now;
+        crossing.i_next = intensity;
+    }
+
+    crossing.t_last = now;
+    crossing.i_last = intensity;
+}
+
+#endif /* SPIN_MODE */
@@ -0,0 +1,55 @@
+#ifndef __SPIN_H__
+#define __SPIN_H__
+
+#include <stdint.h>
+#include "timestamp.h"
+
+/*
+ * Spin mode: the sensor samples autonomously as fast as the ADC allows and
+ * detects the sun crossings from the summed intensity. Each crossing is
+ * reported as a compact event, from which the OBC can estimate the spin
+ * rate and phase without streaming raw samples.
+ */
+
+typedef struct {
+    uint16_t enabled;    // Spin mode sampling on/off
+    uint16_t threshold;  // Summed intensity (0 - 4092) for sun entry
+    uint16_t hysteresis; // Sun exit is at threshold - hysteresis
+} spin_config_t;
+
+typedef struct {
+    uint32_t time;       // Interpolated time of the intensity peak [1/32768 s local time]
+    int16_t x, y;        // Light spot position at the peak sample
+    uint16_t width;      // Time from sun entry to exit [ms], saturates
+    uint16_t intensity;  // Summed intensity at the peak sample
+} spin_event_t;
+
+/* Number of crossing events buffered */
+#define SPIN_QUEUE_LEN 8
+
+extern spin_config_t spin_config; // Stored in FRAM
+
+/*
+ * Take one sample and advance the crossing detector.
+ * Called from the main loop while spin mode is enabled.
+ */
+void spin_task(void);
+
+/*
+ * Restart crossing detection and clear the event queue.
+ */
+void spin_reset(void);
+
+/*
+ * Move up to max oldest events from the queue to dst, packed byte by byte,
+ * so dst needs no alignment (e.g. a response data field).
+ * Returns the number of events copied.
+ */
+unsigned int spin_pop_events(uint8_t* dst, unsigned int max);
+
+/*
+ * Number of events lost to a full queue since the last call.
+ */
+uint8_t spin_dropped_events(void);
+
+#endif /* __SPIN_H__ */
@@ -3,23 +3,56 @@
 #include "main.h"
 #include "calc.h"
 #include "adc.h"
+#include "sample.h"
+#include "spin.h"
+#include "boot.h"
+#include "clock.h"
+#include "profile.h"
+#include "cycles.h"
+#include "energy.h"
+#include "stack.h"
+#include "fram.h"
 #include <msp430.h>
 #include <string.h>
 
-#ifdef DEBUG
-#define SAMPLING_LED_ON()  LED_ON()
-#define SAMPLING_LED_OFF() LED_OFF()
-#else
-#define SAMPLING_LED_ON()
-#define SAMPLING_LED_OFF()
-#endif
-
 static void respond_with_status_code(BusFrame* rsp, uint8_t status_code) {
 	rsp->cmd = RSP_STATUS;
 	rsp->len = 1;
 	rsp->data[0] = status_code;
 }
 
+static void fram_write(void* dst, const void* src, size_t len) {
+	fram_unlock();
+	memcpy(dst, src, len);
+	fram_lock();
+}
+
+#ifdef CALC_CORRECTION
+// Next correction grid row to upload. The grid is valid after the last row.
+static uint8_t correction_row;
+#endif
+
+/*
+ * Measurement responses end with the number of samples averaged in adaptive
+ * oversampling mode, followed by the measured position noise and the capture
+ * time with the sample age [1/32768 s] if enabled.
+ */
+static void append_sample_info(BusFrame* rsp) {
+	if (sampling_config.latency)
+		rsp->data[rsp->len++] = sample.samples;
+	if (sampling_config.report_noise) {
+		memcpy(rsp->data + rsp->len, &sample.noise, sizeof(sample.noise));
+		rsp->len += sizeof(sample.noise);
+	}
+	if (sampling_config.report_time) {
+		uint32_t age = get_time() - sample.capture;
+		uint16_t age16 = age > UINT16_MAX ? UINT16_MAX : (uint16_t)age;
+		memcpy(rsp->data + rsp->len, &sample.capture, sizeof(sample.capture));
+		memcpy(rsp->data + rsp->len + sizeof(sample.capture), &age16, sizeof(age16));
+		rsp->len += sizeof(sample.capture) + sizeof(age16);
+	}
+}
+
 void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 	rsp->dst = cmd->src;
 
@@ -53,14 +86,15 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 	         * Get position of the light spot
 	         */
 
-	        SAMPLING_LED_ON();
-	        read_voltage_channels();
-	        calculate_position();
-	        SAMPLING_LED_OFF();
+	        if (!get_measurement(STAGE_POSITION)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
 
 	        rsp->cmd = RSP_POSITION;
 	        memcpy(rsp->data, &position, sizeof(position));
 	        rsp->len = sizeof(position);
+	        append_sample_info(rsp);
 
 	        break;
 	    }
@@ -70,15 +104,15 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 	         * Get sun vector
 	         */
 
-	        SAMPLING_LED_ON();
-	        read_voltage_channels();
-	        calculate_position();
-	        calculate_vectors();
-	        SAMPLING_LED_OFF();
+	        if (!get_measurement(STAGE_VECTOR)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
 
 	        rsp->cmd = RSP_VECTOR;
 	        memcpy(rsp->data, &vector, sizeof(vector));
 	        rsp->len = sizeof(vector);
+	        append_sample_info(rsp);
 
 	        break;
 	    }
@@ -89,15 +123,15 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 	         * Get sun angle
 	         */
 
-	        SAMPLING_LED_ON();
-	        read_voltage_channels();
-	        calculate_position();
-	        calculate_angles();
-	        SAMPLING_LED_OFF();
+	        if (!get_measurement(STAGE_ANGLES)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
 
 	        rsp->cmd = RSP_ANGLES;
 	        memcpy(rsp->data, &angles, sizeof(angles));
 	        rsp->len = sizeof(angles);
+	        append_sample_info(rsp);
 
 	        break;
 	    }
@@ -107,32 +141,226 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 	         * Get all the measurement data (mainly for testing purposes)
 	         */
 
-	        SAMPLING_LED_ON();
-	        read_voltage_channels();
-	        calculate_position();
-	        calculate_angles();
-	        SAMPLING_LED_OFF();
+	        if (!get_measurement(STAGE_ANGLES)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
 
 	        rsp->cmd = RSP_ALL;
 	        memcpy(rsp->data, &raw, sizeof(raw));
 	        memcpy(rsp->data + sizeof(raw), &position, sizeof(position));
 	        memcpy(rsp->data + sizeof(raw) + sizeof(position), &angles, sizeof(angles));
 	        rsp->len =  sizeof(raw) + sizeof(position) + sizeof(angles);
+	        append_sample_info(rsp);
+	        break;
+
+	    }
+#endif
+
+#ifdef CALC_TRACKER
+	    case CMD_GET_TRACK: {
+	        /*
+	         * Get filtered position and spot velocity from the tracker
+	         */
+
+	        if (!get_measurement(STAGE_POSITION)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
+
+	        rsp->cmd = RSP_TRACK;
+	        memcpy(rsp->data, &track, sizeof(track));
+	        rsp->len = sizeof(track);
+	        append_sample_info(rsp);
+
+	        break;
+	    }
+#endif
+
+#ifdef CALC_UNIT_VECTOR
+	    case CMD_GET_UNIT_VECTOR: {
+	        /*
+	         * Get unit sun vector in Q15, in the body frame if a mounting matrix is set
+	         */
+
+	        if (!get_measurement(STAGE_UNIT)) {
+	            respond_with_status_code(rsp, RSP_STATUS_NO_SUN);
+	            break;
+	        }
+
+	        rsp->cmd = RSP_UNIT_VECTOR;
+	        memcpy(rsp->data, &unit_vector, sizeof(unit_vector));
+	        rsp->len = sizeof(unit_vector);
+	        append_sample_info(rsp);
+
+	        break;
+	    }
+#endif
+
+#ifdef SPIN_MODE
+	    case CMD_GET_SPIN: {
+	        /*
+	         * Read out sun crossing events detected in spin mode.
+	         * Response: event count, events lost to a full queue, events
+	         */
+
+	        unsigned int n = spin_pop_events(rsp->data + 2, SPIN_QUEUE_LEN);
+
+	        rsp->cmd = RSP_SPIN;
+	        rsp->data[0] = n;
+	        rsp->data[1] = spin_dropped_events();
+	        rsp->len = 2 + n * sizeof(spin_event_t);
+
+	        break;
+	    }
+#endif
+
+#ifdef WARM_RESTART
+	    case CMD_GET_BOOT: {
+	        /*
+	         * Reset cause, warm restart flag, boot time and reset counters
+	         */
+
+	        rsp->cmd = RSP_BOOT;
+	        memcpy(rsp->data, &boot_info, sizeof(boot_info));
+	        rsp->len = sizeof(boot_info);
+
+	        break;
+	    }
+#endif
+
+#ifdef CLOCK_SCALING
+	    case CMD_GET_CLOCK: {
+	        /*
+	         * Awake time and handled requests of each clock profile
+	         */
+
+	        rsp->cmd = RSP_CLOCK;
+	        memcpy(rsp->data, &clock_stats, sizeof(clock_stats));
+	        rsp->len = sizeof(clock_stats);
+
+	        break;
+	    }
+#endif
+
+#ifdef PROFILER
+	    case CMD_GET_PROFILE: {
+	        /*
+	         * Min, max, mean and count of each profiled region in Timer B1 ticks,
+	         * and the clock profile of the ticks.
+	         * Data byte 1 clears the table after reading.
+	         */
+
+	        rsp->cmd = RSP_PROFILE;
+	        memcpy(rsp->data, profile_table, sizeof(profile_table));
+	        rsp->len = sizeof(profile_table);
+
+	        if (cmd->len >= 1 && cmd->data[0] == 1)
+	            profile_reset();
+
+	        break;
+	    }
+
+	    case CMD_GET_CYCLES: {
+	        /*
+	         * MCLK cycles of the fixed-point primitives and the calc kernels,
+	         * measured now in the clock profile of the request (cycles.h).
+	         */
+
+	        cycles_report_t report;
+	        cycles_measure(&report);
+
+	        rsp->cmd = RSP_CYCLES;
+	        memcpy(rsp->data, &report, sizeof(report));
+	        rsp->len = sizeof(report);
+
+	        break;
+	    }
+#endif
+
+#ifdef ENERGY_STATS
+	    case CMD_GET_ENERGY: {
+	        /*
+	         * Time active, in LPM0, in LPM3 and with the analog front end powered,
+	         * and active in each clock profile with CLOCK_SCALING, followed by
+	         * the count and mean energy [nJ] of each command code.
+	         */
+
+	        energy_update();
+
+	        rsp->cmd = RSP_ENERGY;
+	        memcpy(rsp->data, &energy_stats, sizeof(energy_stats));
+	        memcpy(rsp->data + sizeof(energy_stats), energy_commands, sizeof(energy_commands));
+	        rsp->len = sizeof(energy_stats) + sizeof(energy_commands);
+
+	        break;
+	    }
+#endif
+
+#ifdef TIME_SYNC
+	    case CMD_SYNC_TIME: {
+	        /*
+	         * Master time [1/32768 s] at the end of the sync word of this frame.
+	         * Usually broadcast, which is not answered. Addressed to one sensor it
+	         * returns the local time error before the sync and the new rate correction.
+	         */
+
+	        uint32_t master;
+	        if (cmd->len != sizeof(master)) {
+	            respond_with_status_code(rsp, RSP_STATUS_INVALID_PARAM);
+	            break;
+	        }
+	        memcpy(&master, cmd->data, sizeof(master));
+	        int32_t error = time_sync(master, bus_sync_ticks);
+
+	        rsp->cmd = RSP_SYNC;
+	        memcpy(rsp->data, &error, sizeof(error));
+	        memcpy(rsp->data + sizeof(error), &time_config.rate, sizeof(time_config.rate));
+	        rsp->len = sizeof(error) + sizeof(time_config.rate);
+
 	        break;
+	    }
+#endif
+
+#ifdef STACK_MONITOR
+	    case CMD_GET_MEMORY: {
+	        /*
+	         * Static RAM, RAM left for the stack and the stack high-water mark in bytes
+	         */
+
+	        stack_stats_t stats;
+	        stack_get_stats(&stats);
 
+	        rsp->cmd = RSP_MEMORY;
+	        memcpy(rsp->data, &stats, sizeof(stats));
+	        rsp->len = sizeof(stats);
+
+	        break;
 	    }
 #endif
 
 	    case CMD_GET_TEMPERATURE: {
 	        /*
-	         * Return MCU temperature reading
+	         * Return MCU temperature reading and its age in milliseconds.
+	         * Temperature is refreshed along with the position sampling,
+	         * so a conversion is made here only if the cached value is too old.
 	         */
 
-            int16_t temp = read_temperature();
+	        timestamp_t age = get_timestamp() - temperature.time;
+	        if (!temperature.valid || age > TEMPERATURE_MAX_AGE) {
+	            if (read_temperature() == TEMPERATURE_ERROR) {
+	                respond_with_status_code(rsp, RSP_STATUS_SAMPLING_ERROR);
+	                break;
+	            }
+	            age = 0;
+	        }
+
+	        int16_t temp = temperature.value + calibration.temperature_bias;
 
 	        rsp->cmd = RSP_TEMPERATURE;
 	        memcpy(rsp->data, &temp, sizeof(temp));
-	        rsp->len = sizeof(temp);
+	        memcpy(rsp->data + sizeof(temp), &age, sizeof(age));
+	        rsp->len = sizeof(temp) + sizeof(age);
 
 	        break;
 	    }
@@ -148,6 +376,110 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
                     memcpy(rsp->data+1, &calibration, sizeof(calibration));
                     rsp->len = sizeof(calibration) +1;
 
+                    break;
+                }
+#ifdef CALC_TRACKER
+                case CMD_CONFIG_TRACKER: {
+                    //
+                    // Get tracker gains
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_TRACKER;
+                    memcpy(rsp->data+1, &tracker_config, sizeof(tracker_config));
+                    rsp->len = sizeof(tracker_config) +1;
+
+                    break;
+                }
+#endif
+                case CMD_CONFIG_SAMPLING: {
+                    //
+                    // Get sampling configuration
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_SAMPLING;
+                    memcpy(rsp->data+1, &sampling_config, sizeof(sampling_config));
+                    rsp->len = sizeof(sampling_config) +1;
+
+                    break;
+                }
+#ifdef SPIN_MODE
+                case CMD_CONFIG_SPIN: {
+                    //
+                    // Get spin mode configuration
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_SPIN;
+                    memcpy(rsp->data+1, &spin_config, sizeof(spin_config));
+                    rsp->len = sizeof(spin_config) +1;
+
+                    break;
+                }
+#endif
+#ifdef CALC_UNIT_VECTOR
+                case CMD_CONFIG_MOUNTING: {
+                    //
+                    // Get sensor mounting matrix
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_MOUNTING;
+                    memcpy(rsp->data+1, &mounting, sizeof(mounting));
+                    rsp->len = sizeof(mounting) +1;
+
+                    break;
+                }
+#endif
+#ifdef CALC_CORRECTION
+                case CMD_CONFIG_CORRECTION: {
+                    //
+                    // Get a row of the correction grid.
+                    // Row out of range returns the grid size and validity.
+                    //
+
+                    uint8_t row = cmd->data[1];
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_CORRECTION;
+                    if (cmd->len == 2 && row < CORRECTION_GRID_N) {
+                        rsp->data[1] = row;
+                        memcpy(rsp->data+2, correction.node[row], sizeof(correction.node[0]));
+                        rsp->len = sizeof(correction.node[0]) + 2;
+                    }
+                    else {
+                        rsp->data[1] = CORRECTION_GRID_N;
+                        rsp->data[2] = (correction.valid == CORRECTION_VALID);
+                        rsp->len = 3;
+                    }
+
+                    break;
+                }
+#endif
+#ifdef CLOCK_SCALING
+                case CMD_CONFIG_CLOCK: {
+                    //
+                    // Get clock profile configuration
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_CLOCK;
+                    memcpy(rsp->data+1, &clock_config, sizeof(clock_config));
+                    rsp->len = sizeof(clock_config) +1;
+
+                    break;
+                }
+#endif
+                case CMD_CONFIG_TIME: {
+                    //
+                    // Get timer rate correction
+                    //
+
+                    rsp->cmd = RSP_CONFIG;
+                    rsp->data[0] = CMD_CONFIG_TIME;
+                    memcpy(rsp->data+1, &time_config, sizeof(time_config));
+                    rsp->len = sizeof(time_config) +1;
+
                     break;
                 }
                 default:
@@ -165,11 +497,28 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
                     //
 
                     if (cmd->len == sizeof(calibration)+1) {
+                        fram_write(&calibration, cmd->data+1, sizeof(calibration));
+                        invalidate_sample();
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
 
-                        SYSCFG0 = FRWPPW; // Disable FRAM write protection
-                        memcpy(&calibration, cmd->data+1, sizeof(calibration));
-                        SYSCFG0 = FRWPPW | PFWP;  // Re-enable FRAM write protection
+                    break;
+                }
+
+#ifdef CALC_TRACKER
+                case CMD_CONFIG_TRACKER: {
+                    //
+                    // Set tracker gains (0 to TRACKER_GAIN_MAX). Restarts the tracker.
+                    //
 
+                    tracker_config_t config;
+                    memcpy(&config, cmd->data+1, sizeof(config));
+                    if (cmd->len == sizeof(tracker_config)+1 &&
+                            config.alpha <= TRACKER_GAIN_MAX && config.beta <= TRACKER_GAIN_MAX) {
+                        fram_write(&tracker_config, &config, sizeof(tracker_config));
+                        reset_tracker();
                         respond_with_status_code(rsp,RSP_STATUS_OK);
                     }
                     else
@@ -177,26 +526,128 @@ void handle_command(const BusFrame* cmd, BusFrame* rsp) {
 
                     break;
                 }
+#endif
 
-#ifdef CALC_ANGLES
-                case CMD_CONFIG_LUT: {
+                case CMD_CONFIG_SAMPLING: {
                     //
-                    // Set a segment of the angle look-up-table
+                    // Set sampling configuration. The sun lost level must not be above the visible level.
                     //
 
-                    unsigned idx = cmd->data[0];
-                    if (cmd->len != 18 && idx < 32) {
-                        SYSCFG0 = FRWPPW; // Disable FRAM write protection
-                        __no_operation();
-                        //memcpy(&lut[idx], cmd->data[1], cmd->len - 1); // TODO
-                        SYSCFG0 = FRWPPW | PFWP;  // Re-enable FRAM write protection
+                    sampling_config_t config;
+                    memcpy(&config, cmd->data+1, sizeof(config));
+                    if (cmd->len == sizeof(sampling_config)+1 && config.sun_off <= config.sun_on) {
+                        fram_write(&sampling_config, &config, sizeof(sampling_config));
+                        // Re-evaluate the sun presence with the new levels
+                        sun_present = 1;
+                        invalidate_sample();
                         respond_with_status_code(rsp,RSP_STATUS_OK);
                     }
                     else
                         respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
+                    break;
+                }
+
+#ifdef SPIN_MODE
+                case CMD_CONFIG_SPIN: {
+                    //
+                    // Set spin mode configuration. Clears the event queue.
+                    //
+
+                    if (cmd->len == sizeof(spin_config)+1) {
+                        fram_write(&spin_config, cmd->data+1, sizeof(spin_config));
+                        spin_reset();
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
+                    break;
+                }
+#endif
+
+#ifdef CALC_UNIT_VECTOR
+                case CMD_CONFIG_MOUNTING: {
+                    //
+                    // Set sensor mounting matrix
+                    //
+
+                    if (cmd->len == sizeof(mounting)+1) {
+                        fram_write(&mounting, cmd->data+1, sizeof(mounting));
+                        invalidate_sample();
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
                     break;
                 }
 #endif
+
+#ifdef CALC_CORRECTION
+                case CMD_CONFIG_CORRECTION: {
+                    //
+                    // Upload the correction grid one row at a time, in order.
+                    // Row 0 disables the grid until the last row has been written.
+                    //
+
+                    uint8_t row = cmd->data[1];
+                    if (cmd->len == sizeof(correction.node[0])+2 && row < CORRECTION_GRID_N &&
+                            (row == 0 || row == correction_row)) {
+                        uint16_t valid = 0;
+                        if (row == 0)
+                            fram_write(&correction.valid, &valid, sizeof(valid));
+
+                        fram_write(correction.node[row], cmd->data+2, sizeof(correction.node[0]));
+                        correction_row = row + 1;
+
+                        if (correction_row == CORRECTION_GRID_N) {
+                            valid = CORRECTION_VALID;
+                            fram_write(&correction.valid, &valid, sizeof(valid));
+                            invalidate_sample();
+                        }
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
+                    break;
+                }
+#endif
+
+#ifdef CLOCK_SCALING
+                case CMD_CONFIG_CLOCK: {
+                    //
+                    // Set clock profile configuration, takes effect from the next request
+                    //
+
+                    if (cmd->len == sizeof(clock_config)+1) {
+                        fram_write(&clock_config, cmd->data+1, sizeof(clock_config));
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
+                    break;
+                }
+#endif
+
+                case CMD_CONFIG_TIME: {
+                    //
+                    // Set timer rate correction, the local time continues from its current value
+                    //
+
+                    if (cmd->len == sizeof(time_config)+1) {
+                        time_rebase();
+                        fram_write(&time_config, cmd->data+1, sizeof(time_config));
+                        respond_with_status_code(rsp,RSP_STATUS_OK);
+                    }
+                    else
+                        respond_with_status_code(rsp,RSP_STATUS_INVALID_PARAM);
+
+                    break;
+                }
+
                 default: {
                     respond_with_status_code(rsp, RSP_STATUS_UNKNOWN_COMMAND);
                 }
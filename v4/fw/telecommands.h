@@ -11,6 +11,16 @@
 #define CMD_GET_ANGLES          0x05
 #define CMD_GET_ALL             0x06
 #define CMD_GET_TEMPERATURE     0x07
+#define CMD_GET_TRACK           0x08
+#define CMD_GET_SPIN            0x09
+#define CMD_GET_UNIT_VECTOR     0x0A
+#define CMD_GET_BOOT            0x0B
+#define CMD_GET_CLOCK           0x0C
+#define CMD_GET_PROFILE         0x0D
+#define CMD_GET_ENERGY          0x0E
+#define CMD_SYNC_TIME           0x0F
+#define CMD_GET_MEMORY          0x10
+#define CMD_GET_CYCLES          0x11
 // GET/SET Config commands
 #define CMD_GET_CONFIG      0xA1
 #define CMD_SET_CONFIG      0xA2
@@ -23,11 +33,27 @@
 #define RSP_ANGLES              0xD5
 #define RSP_ALL                 0xD6
 #define RSP_TEMPERATURE         0xD7
+#define RSP_TRACK               0xD8
+#define RSP_SPIN                0xD9
+#define RSP_UNIT_VECTOR         0xDA
+#define RSP_BOOT                0xDB
+#define RSP_CLOCK               0xDC
+#define RSP_PROFILE             0xDD
+#define RSP_ENERGY              0xDE
+#define RSP_SYNC                0xDF
+#define RSP_MEMORY              0xE0
 #define RSP_CONFIG              0xE1
+#define RSP_CYCLES              0xE2
 
 // Config sub commands
 #define CMD_CONFIG_CALIBRATION  0xB1
-#define CMD_CONFIG_LUT          0xB2
+#define CMD_CONFIG_CORRECTION   0xB2
+#define CMD_CONFIG_TRACKER      0xB3
+#define CMD_CONFIG_SAMPLING     0xB4
+#define CMD_CONFIG_SPIN         0xB5
+#define CMD_CONFIG_MOUNTING     0xB6
+#define CMD_CONFIG_CLOCK        0xB7
+#define CMD_CONFIG_TIME         0xB8
 
 /* Status codes: */
 #define RSP_STATUS_OK                 0xF0
@@ -40,6 +66,7 @@
 #define RSP_STATUS_DIVISION_ZERO      0xF6
 #define RSP_STATUS_NOT_ODD            0xF7
 #define RSP_STATUS_CALC_ERROR         0xF8
+#define RSP_STATUS_NO_SUN             0xF9
 
 /* Subsystem-specific command handler.
  * Return 1 if there is a response, 0 if not. */
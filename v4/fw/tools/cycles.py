@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+    Cycle counts of the fixed-point primitives and the calc kernels, measured
+    on the sensor by a PROFILER build (CMD_GET_CYCLES, see cycles.h).
+
+    Prints the MCLK cycles per call of each kernel. The build decides the
+    column: FIXMATH_SOFTWARE measures the primitives without MPY32, RAM_CODE
+    the functions placed in RAM, and the clock profile of the request the
+    FRAM wait states (burst, 16 MHz, with CLOCK_SCALING).
+
+    The emulator advances the timers only where the firmware waits, so its
+    counts are 0 and only check the command.
+
+    --save writes the cycles per call by function name. memreport.py --cycles
+    takes the files of a build without and one with RAM_CODE, both measured
+    in the burst profile, for the cycles the RAM placement saves.
+
+    Examples:
+        ./cycles.py /dev/ttyUSB0 --baud 115200
+        ./cycles.py /dev/ttyUSB0 --baud 115200 --save fram.txt
+        ./cycles.py /tmp/psd
+"""
+
+import os
+import sys
+import time
+import struct
+import argparse
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "host", "emu"))
+from loadtest import Port, frame, ADDRESS_OBC, ADDRESS_PSD_XP, HEADER_BYTES, CRC_BYTES
+
+
+CMD_GET_CYCLES = 0x11
+RSP_CYCLES = 0xE2
+
+# In the order of the CYC_ defines of cycles.h: function, label
+KERNELS = [
+    ("fix_mul_u16", "fix_mul_u16"),
+    ("fix_mul_s16", "fix_mul_s16"),
+    ("fix_mul_s32_s16", "fix_mul_s32_s16"),
+    ("fix_q15_mul", "fix_q15_mul"),
+    ("fix_mac_s16", "fix_mac_s16"),
+    ("fix_q31_mul", "fix_q31_mul"),
+    ("fix_recip", "fix_recip"),
+    ("fix_div_q11", "fix_div_q11"),
+    ("fix_q15_div", "fix_q15_div"),
+    ("fix_rsqrt", "fix_rsqrt"),
+    ("calculate_position", "calculate_position"),
+    ("position_divide", "calculate_position (2 div)"),
+    ("calculate_angles", "calculate_angles"),
+    ("calculate_unit_vector", "calculate_unit_vector"),
+    ("bus_crc16", "bus_crc16 (16 bytes)"),
+]
+
+CLOCKS = ["idle", "burst"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Kernel cycle counts")
+    parser.add_argument("port", help="Serial port or emulator pty")
+    parser.add_argument("--baud", type=int, default=0, help="Baud rate of a serial port")
+    parser.add_argument("--address", type=lambda x: int(x, 0), default=ADDRESS_PSD_XP, help="Sensor address")
+    parser.add_argument("--timeout", type=float, default=1.0, help="Response timeout [s]")
+    parser.add_argument("--save", help="Also write the cycles per call to this file, for memreport.py --cycles")
+    args = parser.parse_args()
+
+    port = Port(args.port, args.baud)
+    port.flush_input()
+    port.write(frame(ADDRESS_OBC, args.address, CMD_GET_CYCLES))
+    rsp, _ = port.read_frame(time.monotonic() + args.timeout)
+    if rsp is None:
+        sys.exit("no response")
+    if rsp[6] != RSP_CYCLES:
+        sys.exit("response 0x%02X, not a PROFILER build?" % rsp[6])
+
+    data = rsp[HEADER_BYTES:-CRC_BYTES]
+    calls, clock, software = struct.unpack_from("<HBB", data)
+    cycles = struct.unpack_from("<%dI" % len(KERNELS), data, 4)
+
+    header = "%d calls each, clock profile %s, %s multiply" % (
+        calls, CLOCKS[clock] if clock < len(CLOCKS) else clock, "software" if software else "MPY32")
+    print(header)
+    for (_, label), total in zip(KERNELS, cycles):
+        if total:
+            print("  %-28s %8.1f" % (label, total / calls))
+        else:
+            print("  %-28s %8s" % (label, "-"))
+
+    if args.save:
+        with open(args.save, "w") as f:
+            f.write("# %s\n" % header)
+            for (function, _), total in zip(KERNELS, cycles):
+                if total:
+                    f.write("%-24s %.1f\n" % (function, total / calls))
+
+
+if __name__ == "__main__":
+    main()
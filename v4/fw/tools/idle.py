@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+    Idle current of the sensor over one idle reset cycle, from the times in
+    each power mode of an ENERGY_STATS build (CMD_GET_ENERGY, see energy.h).
+
+    Sends one request and leaves the bus idle for just under two idle reset
+    timeouts: the sensor resets after the first, boots and idles until the
+    time is read. The times then cover the boot from energy_init() and a
+    whole idle cycle up to the next reset, including the sleep transition.
+    The reset itself and the start-up before energy_init() are not counted.
+
+    Prints the share of the time active, in LPM0 and LPM3 and with the analog
+    front end powered, and the mean supply current with the currents of
+    energy.h (override them with the currents measured on the board). Run it
+    with and without TICKLESS_IDLE to compare.
+
+    The emulator counts only the host time spent between the interrupt
+    points as active, its active share is far below the target's.
+
+    Examples:
+        ./idle.py /dev/ttyUSB0 --baud 115200
+        ./idle.py /tmp/psd --lpm3-ua 1.5
+"""
+
+import os
+import sys
+import time
+import struct
+import argparse
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "host", "emu"))
+from loadtest import Port, request, ADDRESS_PSD_XP, IDLE_RESET, TIMER_HZ
+
+
+CMD_GET_ENERGY = 0x0E
+
+# energy_stats_t: time[3], afe, and active[2] with CLOCK_SCALING
+STATS_BYTES = 16
+CLOCK_STATS_BYTES = 24
+COMMANDS_BYTES = 16 * 4
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Idle current from the energy statistics")
+    parser.add_argument("port", help="Serial port or emulator pty")
+    parser.add_argument("--baud", type=int, default=0, help="Baud rate of a serial port")
+    parser.add_argument("--address", type=lambda x: int(x, 0), default=ADDRESS_PSD_XP, help="Sensor address")
+    parser.add_argument("--active-ua", type=float, default=1000, help="Active current, 8 MHz or burst profile [uA]")
+    parser.add_argument("--idle-ua", type=float, default=500, help="Active current of the idle profile [uA]")
+    parser.add_argument("--lpm0-ua", type=float, default=200, help="LPM0 current [uA]")
+    parser.add_argument("--lpm3-ua", type=float, default=15, help="LPM3 current [uA]")
+    parser.add_argument("--afe-ua", type=float, default=400, help="Analog front end current [uA]")
+    args = parser.parse_args()
+
+    port = Port(args.port, args.baud)
+    port.flush_input()
+
+    # Also starts the idle timeout
+    request(port, args.address, CMD_GET_ENERGY)
+
+    wait = 2 * IDLE_RESET - 1
+    print("idle for %.0f s" % wait)
+    time.sleep(wait)
+    port.flush_input()
+
+    data = request(port, args.address, CMD_GET_ENERGY)
+    active, lpm0, lpm3, afe = struct.unpack_from("<4I", data)
+    if len(data) == CLOCK_STATS_BYTES + COMMANDS_BYTES:
+        burst, idle = struct.unpack_from("<2I", data, STATS_BYTES)
+        charge = burst * args.active_ua + idle * args.idle_ua
+    else:
+        charge = active * args.active_ua
+    charge += lpm0 * args.lpm0_ua + lpm3 * args.lpm3_ua + afe * args.afe_ua
+
+    total = active + lpm0 + lpm3
+    if not total:
+        sys.exit("no time counted")
+
+    print("since boot  %.2f s" % (total / TIMER_HZ))
+    for name, ticks in (("active", active), ("LPM0", lpm0), ("LPM3", lpm3), ("AFE", afe)):
+        print("  %-8s %10.3f ms  %7.3f %%" % (name, ticks * 1000.0 / TIMER_HZ, ticks * 100.0 / total))
+    print("mean current  %.1f uA" % (charge / total))
+
+
+if __name__ == "__main__":
+    main()
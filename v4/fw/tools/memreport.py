@@ -0,0 +1,353 @@
+#!/usr/bin/env python3
+"""
+    Memory report of the v4 firmware build.
+
+    With the linker map, lists the RAM, FRAM and information FRAM used by
+    every module and the largest symbols, and checks them against the
+    budgets of tools/budgets.txt. Initialized data counts to RAM and, for
+    its load image, to FRAM. Symbol sizes come from the ELF if given, the
+    map has only the addresses of the global symbols.
+
+    Lists the functions placed in RAM (RAM_CODE, see platform/ramfunc.h)
+    with their RAM cost and the cycles they save per bus request,
+    so the 1 KB RAM is traded for latency deliberately.
+
+    Sizes of the RAM placement come from the ELF symbol table. The savings
+    are measured with --cycles: the tools/cycles.py --save files of a
+    PROFILER build without and one with RAM_CODE, both in the 16 MHz burst
+    profile (NWAITS_1, CLOCK_SCALING). Items cycles.py does not time, and
+    all items without --cycles, show estimates of the FRAM wait states
+    avoided, marked "est." in the report. At 8 MHz and below FRAM has no
+    wait states and nothing is saved.
+
+    Exits with an error if a budget is exceeded, or if the static RAM
+    (.data, .bss and the RAM code) and the stack reserve exceed the RAM.
+
+    Examples:
+        ./memreport.py ../build/PSD_SUNSENSOR.elf
+        ./memreport.py --map ../build/PSD_SUNSENSOR.map --budgets budgets.txt ../build/PSD_SUNSENSOR.elf
+        ./memreport.py --nm /opt/msp430-gcc/bin/msp430-elf-nm ../build/PSD_SUNSENSOR.elf
+        ./memreport.py --cycles fram.txt ram.txt ../build/PSD_SUNSENSOR.elf
+"""
+
+import os
+import re
+import sys
+import argparse
+import subprocess
+
+
+RAM_START = 0x2000
+RAM_END = 0x2400
+
+# RAM kept free for the stack, the interrupts nest on it [bytes]
+STACK_RESERVE = 160
+
+REGIONS = [
+    # name, start, end
+    ("RAM", RAM_START, RAM_END),
+    ("FRAM", 0xF100, 0xFF80),
+    ("INFO", 0x1800, 0x1A00),
+]
+
+# Savings of each placeable item: calls per request, and the estimated cycles
+# saved per call (16 MHz, one wait state per cache miss) unless measured
+SAVINGS = {
+    # ~9 request bytes and ~30 response bytes, ~40 instruction words each
+    "bus_primary_irq":      (40, 10, "UART interrupt, per byte"),
+    # The loop is cache resident after the first byte, saves the entry and exit
+    "bus_crc16":            (2, 4, "CRC of the request and the response"),
+    # Includes the two fix_div_q11() calls, measured that way too
+    "calculate_position":   (1, 31, "Per sample, 1 sample per request by default"),
+    "fix_div_q11":          (1, 8, "calculate_noise(), the position divisions count above"),
+}
+
+
+def region_of(addr):
+    for name, start, end in REGIONS:
+        if start <= addr < end:
+            return name
+    return None
+
+
+def module_of(path):
+    """ Object file name, or the library of an archive member """
+    path = path.strip()
+    if "(" in path:
+        path = path.split("(")[0]
+    return os.path.basename(path)
+
+
+###############################################################################
+# Linker map
+
+OUTPUT_RE = re.compile(r"^(\.\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+load address 0x([0-9a-f]+))?)?\s*$")
+INPUT_RE = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?$")
+CONT_RE = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+(\S.*))?$")
+SYMBOL_RE = re.compile(r"^\s+0x([0-9a-f]+)\s+([A-Za-z_][A-Za-z0-9_.$]*)\s*$")
+
+
+def parse_map(path):
+    """ Input sections (module, address, size, load address) and their global symbols """
+    sections = []
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    try:
+        start = lines.index("Linker script and memory map") + 1
+    except ValueError:
+        sys.exit("%s is not a GNU ld map file" % path)
+
+    out_addr = out_load = None
+    pending = None  # Section name wrapped to the next line
+    for line in lines[start:]:
+        if line.startswith("Cross Reference Table"):
+            break
+        if not line.strip():
+            continue
+
+        if not line.startswith(" "):
+            m = OUTPUT_RE.match(line)
+            if m:
+                out_addr = int(m.group(2), 16) if m.group(2) else None
+                out_load = int(m.group(4), 16) if m.group(4) else None
+                pending = "output" if not m.group(2) else None
+            continue
+
+        if pending == "output":
+            m = CONT_RE.match(line)
+            if m:
+                out_addr = int(m.group(1), 16)
+                out_load = None
+                if m.group(3) and m.group(3).startswith("load address"):
+                    out_load = int(m.group(3).split()[-1], 16)
+            pending = None
+            continue
+
+        m = SYMBOL_RE.match(line)
+        if m and sections and pending is None:
+            sections[-1]["symbols"].append((int(m.group(1), 16), m.group(2)))
+            continue
+
+        if pending:
+            m = CONT_RE.match(line)
+            if m and m.group(3):
+                add_section(sections, pending, int(m.group(1), 16), int(m.group(2), 16),
+                            m.group(3), out_addr, out_load)
+            pending = None
+            continue
+
+        m = INPUT_RE.match(line)
+        if m and not m.group(1).startswith("*"):
+            if m.group(2) is None:
+                pending = m.group(1)
+            else:
+                add_section(sections, m.group(1), int(m.group(2), 16), int(m.group(3), 16),
+                            m.group(4), out_addr, out_load)
+    return sections
+
+
+def add_section(sections, name, addr, size, path, out_addr, out_load):
+    load = None
+    if out_load is not None and out_addr is not None:
+        load = out_load + addr - out_addr
+    sections.append({"name": name, "addr": addr, "size": size, "load": load,
+                     "module": module_of(path), "symbols": []})
+
+
+def usage(sections, table=None):
+    """ Bytes per module and region, and the sized symbols """
+    modules = {}
+    symbols = []
+    for s in sections:
+        if s["size"] == 0:
+            continue
+        used = modules.setdefault(s["module"], {})
+        region = region_of(s["addr"])
+        if region:
+            used[region] = used.get(region, 0) + s["size"]
+        # Initialized data is also stored in FRAM
+        if s["load"] is not None and region_of(s["load"]) == "FRAM" and region != "FRAM":
+            used["FRAM"] = used.get("FRAM", 0) + s["size"]
+
+        if table is not None or not region:
+            continue
+        syms = sorted(s["symbols"])
+        for i, (addr, name) in enumerate(syms):
+            end = syms[i + 1][0] if i + 1 < len(syms) else s["addr"] + s["size"]
+            if end > addr:
+                symbols.append((name, s["module"], region, end - addr))
+
+    # ELF symbols, including the static ones, in the module of their section
+    if table is not None:
+        for name, (addr, size) in table.items():
+            region = region_of(addr)
+            if size == 0 or not region:
+                continue
+            module = next((s["module"] for s in sections
+                           if s["addr"] <= addr < s["addr"] + s["size"]), "")
+            symbols.append((name, module, region, size))
+    return modules, symbols
+
+
+def read_budgets(path):
+    """ (region, module or *, bytes) of each budget line """
+    budgets = []
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].split()
+            if len(line) == 3:
+                budgets.append((line[0], line[1], int(line[2])))
+    return budgets
+
+
+def print_usage(modules, symbols, top):
+    names = [r[0] for r in REGIONS]
+    print("%-24s" % "Module" + "".join("%8s" % n for n in names))
+    totals = dict.fromkeys(names, 0)
+    for module in sorted(modules, key=lambda m: -sum(modules[m].values())):
+        print("%-24s" % module + "".join("%8d" % modules[module].get(n, 0) for n in names))
+        for n in names:
+            totals[n] += modules[module].get(n, 0)
+    print("%-24s" % "total" + "".join("%8d" % totals[n] for n in names))
+    print("%-24s" % "size" + "".join("%8d" % (end - start) for _, start, end in REGIONS))
+    print()
+
+    print("%-24s %-16s %-6s %6s" % ("Symbol", "Module", "Region", "bytes"))
+    for name, module, region, size in sorted(symbols, key=lambda s: -s[3])[:top]:
+        print("%-24s %-16s %-6s %6d" % (name, module, region, size))
+    print()
+    return totals
+
+
+def check_budgets(budgets, modules, totals):
+    """ Print every budget, returns the number exceeded """
+    over = 0
+    print("%-6s %-24s %8s %8s" % ("Budget", "", "used", "budget"))
+    for region, module, limit in budgets:
+        used = totals.get(region, 0) if module == "*" else modules.get(module, {}).get(region, 0)
+        status = "OK" if used <= limit else "OVER"
+        over += used > limit
+        print("%-6s %-24s %8d %8d  %s" % (region, "total" if module == "*" else module, used, limit, status))
+    print()
+    return over
+
+
+def check_ram(used, stack):
+    """ Static RAM and the stack reserve against the RAM size, returns 1 if they do not fit """
+    size = RAM_END - RAM_START
+    fits = used + stack <= size
+    print("RAM    static %d + stack %d = %d of %d bytes  %s" % (used, stack, used + stack, size, "OK" if fits else "OVER"))
+    print()
+    return 0 if fits else 1
+
+
+###############################################################################
+# RAM placement
+
+def symbols(nm, elf):
+    """ Name -> (address, size) of the sized symbols """
+    out = subprocess.run([nm, "-S", elf], capture_output=True, text=True, check=True).stdout
+    table = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            addr, size, _, name = fields
+            table[name] = (int(addr, 16), int(size, 16))
+        elif len(fields) == 3:
+            addr, _, name = fields
+            table[name] = (int(addr, 16), 0)
+    return table
+
+
+def ram_placement(table):
+    """ Items linked to RAM that are known placements or in .ramtext """
+    start = table.get("__ramtext_start", (0, 0))[0]
+    end = table.get("__ramtext_end", (0, 0))[0]
+    items = []
+    for name, (addr, size) in table.items():
+        if size == 0:
+            continue
+        if start <= addr < end or (name in SAVINGS and RAM_START <= addr < RAM_END):
+            items.append((name, size))
+    return sorted(items, key=lambda item: item[0])
+
+
+def read_cycles(path):
+    """ Cycles per call by function, from tools/cycles.py --save """
+    cycles = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].strip()
+            if line:
+                name, value = line.split()
+                cycles[name] = float(value)
+    return cycles
+
+
+def print_placement(items, fram=None, ram=None):
+    if not items:
+        print("Nothing placed in RAM, build with FEATURES=\"RAM_CODE\"")
+        return
+
+    print("%-20s %6s %14s %12s %-8s  %s" % ("RAM placement", "bytes", "cycles/request", "cycles/byte", "saving", ""))
+    total_bytes = total_cycles = 0
+    estimated = False
+    for name, size in items:
+        calls, saved, note = SAVINGS.get(name, (0, 0, "no estimate, add to SAVINGS"))
+        if fram and ram and name in fram and name in ram:
+            saved = fram[name] - ram[name]
+            source = "measured"
+        else:
+            source = "est."
+            estimated = True
+        cycles = calls * saved
+        total_bytes += size
+        total_cycles += cycles
+        print("%-20s %6d %14.0f %12.2f %-8s  %s" % (name, size, cycles, cycles / size, source, note))
+    print("%-20s %6d %14.0f %12.2f %-8s  %.1f us per request at 16 MHz" % (
+        "total", total_bytes, total_cycles, total_cycles / total_bytes, "est." if estimated else "measured",
+        total_cycles / 16.0))
+    print("%d of %d bytes RAM" % (total_bytes, RAM_END - RAM_START))
+    if estimated:
+        print("est.: estimated FRAM wait states, measure with tools/cycles.py and --cycles")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Memory report of the firmware build")
+    parser.add_argument("elf", nargs="?", help="Linked firmware, for the RAM placement")
+    parser.add_argument("--nm", default="msp430-elf-nm", help="nm of the MSP430 toolchain")
+    parser.add_argument("--map", help="Linker map, for the usage per module and symbol")
+    parser.add_argument("--budgets", help="Budget file checked against the map")
+    parser.add_argument("--top", type=int, default=20, help="Number of symbols listed")
+    parser.add_argument("--stack", type=int, default=STACK_RESERVE, help="Stack reserve [bytes]")
+    parser.add_argument("--cycles", nargs=2, metavar=("FRAM", "RAM"),
+                        help="tools/cycles.py --save files without and with RAM_CODE, for measured savings")
+    args = parser.parse_args()
+
+    table = symbols(args.nm, args.elf) if args.elf else None
+
+    over = 0
+    if args.map:
+        modules, syms = usage(parse_map(args.map), table)
+        totals = print_usage(modules, syms, args.top)
+        if args.budgets:
+            over = check_budgets(read_budgets(args.budgets), modules, totals)
+        over += check_ram(totals["RAM"], args.stack)
+    elif table is not None:
+        # Without the map only the sized symbols are known
+        used = sum(size for addr, size in table.values() if RAM_START <= addr < RAM_END)
+        over += check_ram(used, args.stack)
+
+    if table is not None:
+        if args.cycles:
+            print_placement(ram_placement(table), read_cycles(args.cycles[0]), read_cycles(args.cycles[1]))
+        else:
+            print_placement(ram_placement(table))
+
+    if over:
+        sys.exit("%d budget(s) exceeded" % over)
+
+
+if __name__ == "__main__":
+    main()